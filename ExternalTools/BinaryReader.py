@@ -1,34 +1,131 @@
+import json
+import os
+import sys
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+
 import numpy as np
 
-# Open the binary file
-with open('dataset.bin', 'rb') as file:
-    # Record the file size
-    file.seek(0, 2)  # Seek to the end of the file to get its size
-    file_size = file.tell()  # Get the current position, which is the size of the file
-    file.seek(0)  # Seek back to the beginning of the file
-    
-    # Read the first 4 bytes as an integer
-    int_value = np.frombuffer(file.read(4), dtype=np.int32)[0]
-
-    # Read the next 'int_value' number of integers
-    int_array = np.frombuffer(file.read(int_value * 4), dtype=np.int32)
-
-    num_floats = 1
-    for i in int_array:
-        num_floats *= i
-
-    # Read the next 'int_array' number of floats
-    float_array = np.frombuffer(file.read(num_floats * 4), dtype=np.float32)
-    float_array = float_array.reshape(int_array)
-
-    # Check if the file has been fully read
-    bytes_read = file.tell()  # Get the current position of the file pointer
-    
-    if bytes_read == file_size:
-        print("The whole file has been read.")
+ENCODING_TYPES = {
+    'float32': np.float32,
+    'float16': np.float16,
+    'quantized16': np.uint16,
+    'quantized8': np.uint8,
+}
+
+
+def read_binary(path, dtype=np.float32):
+    # Reads a single [dimension array size][dimensions array][raw data] file
+    with open(path, 'rb') as file:
+        # Record the file size
+        file.seek(0, 2)  # Seek to the end of the file to get its size
+        file_size = file.tell()  # Get the current position, which is the size of the file
+        file.seek(0)  # Seek back to the beginning of the file
+
+        # Read the first 4 bytes as an integer
+        int_value = np.frombuffer(file.read(4), dtype=np.int32)[0]
+
+        # Read the next 'int_value' number of integers
+        int_array = np.frombuffer(file.read(int_value * 4), dtype=np.int32)
+
+        num_values = 1
+        for i in int_array:
+            num_values *= i
+
+        # Read the next 'int_array' number of values
+        data = np.frombuffer(file.read(num_values * np.dtype(dtype).itemsize), dtype=dtype)
+        data = data.reshape(int_array)
+
+        # Check if the file has been fully read
+        bytes_read = file.tell()  # Get the current position of the file pointer
+
+        if bytes_read != file_size:
+            print(f"Not all data was read from {path}. {file_size - bytes_read} bytes remain.")
+
+    return data
+
+
+def read_manifest(path):
+    # Reads the manifest written next to the shards of a sharded export, e.g. dataset.bin.manifest.json
+    with open(path, 'r') as file:
+        manifest = json.load(file)
+    manifest['directory'] = os.path.dirname(os.path.abspath(path))
+    return manifest
+
+
+def read_shard(manifest, index):
+    # Decompresses and decodes a single shard into a float32 array of shape [num_rows, *dimensions[1:]]
+    shard = manifest['shards'][index]
+    with open(os.path.join(manifest['directory'], shard['file']), 'rb') as file:
+        payload = file.read()
+
+    compression = manifest['compression']
+    if compression == 'lz4':
+        import lz4.block
+        raw = lz4.block.decompress(payload, uncompressed_size=shard['raw_size'])
+    elif compression == 'zlib':
+        raw = zlib.decompress(payload)
+    elif compression == 'oodle':
+        raise NotImplementedError('Oodle shards can only be read through UBinaryBuilder::LoadShard')
     else:
-        print(f"Not all data was read. {file_size - bytes_read} bytes remain.")
+        raw = payload
+
+    encoding = manifest['encoding']
+    data = np.frombuffer(raw, dtype=ENCODING_TYPES[encoding])
+    data = data.reshape((shard['num_rows'], manifest['row_size']))
+
+    if encoding.startswith('quantized'):
+        # Every shard has its own column ranges, manifests of version 1 store a single range for all shards
+        scale = np.asarray(shard.get('scale', manifest.get('scale')), dtype=np.float32)
+        offset = np.asarray(shard.get('offset', manifest.get('offset')), dtype=np.float32)
+        data = data.astype(np.float32) * scale + offset
+    else:
+        data = data.astype(np.float32)
+
+    return data.reshape([shard['num_rows']] + manifest['dimensions'][1:])
+
+
+def iter_shards(manifest, workers=4):
+    # Yields (first_row, data) for every shard in order while the following shards are read in parallel
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        futures = [executor.submit(read_shard, manifest, i) for i in range(len(manifest['shards']))]
+        for shard, future in zip(manifest['shards'], futures):
+            yield shard['first_row'], future.result()
+
+
+def read_sharded(path, workers=4):
+    # Reads all shards of a manifest into a single array
+    manifest = read_manifest(path)
+    data = np.empty(manifest['dimensions'], dtype=np.float32)
+    for first_row, shard in iter_shards(manifest, workers):
+        data[first_row:first_row + len(shard)] = shard
+    return data
+
+
+def read_dataset_file(path, workers=4):
+    # Reads either the monolithic file or, if present, its sharded version
+    if os.path.exists(path + '.manifest.json'):
+        return read_sharded(path + '.manifest.json', workers)
+    return read_binary(path)
+
+
+def read_windows(folder):
+    # Reads the window start frames and the [start, count] of every sequence written next to the dataset
+    windows = read_binary(os.path.join(folder, 'windows.bin'), dtype=np.int32)
+    sequences = read_binary(os.path.join(folder, 'sequences.bin'), dtype=np.int32)
+    return windows, sequences
+
+
+def window_view(data, history, future):
+    # Zero copy view of all windows of history + future frames, window i starts at frame i of the flat data
+    # Index it with the entries of windows.bin to only get windows that stay within a single sequence
+    if history < 0 or future < 0 or history + future < 1:
+        raise ValueError('history and future must not be negative and add up to a window of at least 1 frame, got %d + %d' % (history, future))
+    view = np.lib.stride_tricks.sliding_window_view(data, history + future, axis=0)
+    return np.moveaxis(view, -1, 1)
+
 
-print(int_value)
-print(int_array)
-print(float_array.shape)
+if __name__ == '__main__':
+    path = sys.argv[1] if len(sys.argv) > 1 else 'dataset.bin'
+    data = read_dataset_file(path)
+    print(data.shape)
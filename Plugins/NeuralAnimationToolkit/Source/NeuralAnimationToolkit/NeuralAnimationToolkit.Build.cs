@@ -11,35 +11,15 @@ public class NeuralAnimationToolkit : ModuleRules
             "Core",
             "CoreUObject",
             "Engine",
-            "Slate",
-            "SlateCore",
-            "UMG",
             "AnimationCore",
             "AnimGraphRuntime",
-            "AnimGraph",
-            "StructUtils",
-            "BlueprintGraph",
+            "DeveloperSettings",
+            "NNE",
         });
 
         PrivateDependencyModuleNames.AddRange(new string[]
         {
-            "Projects",
-            "EditorFramework",
-            "UnrealEd",
-            "ToolMenus",
-            "NNE",
-            "Blutility",
-            "UMGEditor",
-            "ScriptableEditorWidgets",
+            "Json",
         });
-
-        if (Target.bBuildEditor)
-        {
-            PrivateDependencyModuleNames.AddRange(new string[]
-            {
-                "LevelEditor",
-                "ToolMenus",
-            });
-        }
     }
 }
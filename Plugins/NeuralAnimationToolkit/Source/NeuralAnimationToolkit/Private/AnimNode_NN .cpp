@@ -1,5 +1,22 @@
 #include "AnimNode_NN.h"
 
+void FPoseExtrapolation::Init(int32 NumBones) {
+	Positions.Init(FVector::ZeroVector, NumBones);
+	Rotations.Init(FQuat::Identity, NumBones);
+	Velocities.Init(FVector::ZeroVector, NumBones);
+	AngularVelocities.Init(FVector::ZeroVector, NumBones);
+}
+
+void FPoseExtrapolation::Evaluate(float Time, TArray<FVector>& OutPositions, TArray<FQuat>& OutRotations) const {
+	OutPositions.SetNum(Positions.Num());
+	OutRotations.SetNum(Rotations.Num());
+	for (int i = 0; i < Positions.Num(); i++) {
+		OutPositions[i] = Positions[i] + Velocities[i] * Time;
+		OutRotations[i] = UFeatureComputation::QuatFromScaledAngleAxis(AngularVelocities[i] * Time) * Rotations[i];
+		OutRotations[i].Normalize();
+	}
+}
+
 FAnimNode_NN::FAnimNode_NN() {
 }
 
@@ -8,10 +25,46 @@ void FAnimNode_NN::Initialize_AnyThread(const FAnimationInitializeContext& Conte
 	Super::Initialize_AnyThread(Context);
 	Source.Initialize(Context);
 
+	// Start creating the model right away so it is usually ready by the first evaluation
+	RequestModelLOD(Context);
+
+	const int32 NumOutputBones = FeatureSet->OutputBones.Num();
+	BonePositions.Init(FVector::ZeroVector, NumOutputBones);
+	BoneRotations.Init(FQuat::Identity, NumOutputBones);
+	BoneVelocities.Init(FVector::ZeroVector, NumOutputBones);
+	BoneAngularVelocities.Init(FVector::ZeroVector, NumOutputBones);
+	OutputPositions.Init(FVector::ZeroVector, NumOutputBones);
+	OutputRotations.Init(FQuat::Identity, NumOutputBones);
+	Extrapolation.Init(NumOutputBones);
+	BlendSource.Init(NumOutputBones);
+	TimeSinceResult = 0.0f;
+	StepPreviousPositions.Init(FVector::ZeroVector, NumOutputBones);
+	StepPreviousRotations.Init(FQuat::Identity, NumOutputBones);
+	StepAccumulator = 0.0f;
+	StepSampleTime = 0.0f;
+	StepAlpha = 1.0f;
+
 	if (isInertialised) {
-		for (FBoneReference& BoneReference : FeatureSet->OutputBones) {
-			Inertializers.Add(FTransformSpring(halfLife));
+		if (InertialisationMode == EInertialisationMode::Offset) {
+			OffsetInertializer = FOffsetInertializer(halfLife);
+			OffsetInertializer.PositionThreshold = DiscontinuityPositionThreshold;
+			OffsetInertializer.RotationThreshold = DiscontinuityRotationThreshold;
+			OffsetInertializer.Initialize(NumOutputBones);
 		}
+		else if (InertialisationMode == EInertialisationMode::SavitzkyGolay) {
+			// Position and rotation of every bone
+			ResultFilter.Initialize(NumOutputBones * 7, SavGolWindowLength, SavGolPolyOrder, SavGolLatency);
+		}
+		else {
+			Inertializer = FTransformSpringBank(halfLife);
+			Inertializer.Initialize(NumOutputBones);
+		}
+	}
+	OutputSmoothing.Reset();
+	bHasOutputPose = false;
+
+	if (isModelInitialized) {
+		BindOutputBones(false);
 	}
 }
 
@@ -25,6 +78,7 @@ void FAnimNode_NN::CacheBones_AnyThread(const FAnimationCacheBonesContext& Conte
 		BoneReference.Initialize(BoneContainer);
 	}
 	FeatureSet->InitialiseFeaturesRealTime(BoneContainer);
+	CacheOutputBones(BoneContainer);
 }
 
 void FAnimNode_NN::Update_AnyThread(const FAnimationUpdateContext& Context)
@@ -33,13 +87,42 @@ void FAnimNode_NN::Update_AnyThread(const FAnimationUpdateContext& Context)
 	GetEvaluateGraphExposedInputs().Execute(Context);
 	Source.Update(Context);
 
+	const FBoneContainer& BoneContainer = Context.AnimInstanceProxy->GetRequiredBones();
 	if (FeatureSet->OutputBones.Num() != 0 && !isBonesRefInitialized) {
-		const FBoneContainer& BoneContainer = Context.AnimInstanceProxy->GetRequiredBones();
 		for (FBoneReference& BoneReference : FeatureSet->OutputBones) {
 			BoneReference.Initialize(BoneContainer);
 		}
 		FeatureSet->InitialiseFeaturesRealTime(BoneContainer);
 	}
+
+	RequestModelLOD(Context);
+	UpdatePendingModel();
+
+	// The features come from the source pose of the previous frame, so the inference runs while the rest of the graph updates and evaluates
+	if (IsPipelinedActive() && isRunning && isModelInitialized && !bPipelinedResultPending && bHasPipelinePose) {
+		const float DeltaTime = Context.GetDeltaTime();
+		const bool bIsSameBones = PipelinePose.GetBoneContainer().GetSerialNumber() == BoneContainer.GetSerialNumber();
+
+		if (bIsSameBones && IsInferenceDue(TimeSinceResult + DeltaTime)) {
+			// The pooled component space pose holds the previous frame's pose until Evaluate fills it again
+			ComponentSpacePose.InitPose(PipelinePose);
+			bIsComponentSpacePoseValid = false;
+
+			if (PrepareInference(BoneContainer, ComponentSpacePose, DeltaTime)) {
+				if (FindMemoizedOutput()) {
+					bPipelinedResultMemoized = true;
+				}
+				else {
+					TSharedPtr<FModelInstance> ModelInstancePtr = ModelInstance;
+					PipelinedInference = FInferenceExecutor::Get().Launch([ModelInstancePtr]()
+						{
+							return ModelInstancePtr->RunModel();
+						}).Share();
+				}
+				bPipelinedResultPending = true;
+			}
+		}
+	}
 }
 
 void FAnimNode_NN::Evaluate_AnyThread(FPoseContext& Output)
@@ -47,28 +130,69 @@ void FAnimNode_NN::Evaluate_AnyThread(FPoseContext& Output)
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(Evaluate_AnyThread)
 	Source.Evaluate(Output);
 	const FBoneContainer& BoneContainer = Output.AnimInstanceProxy->GetRequiredBones();
+	bIsComponentSpacePoseValid = false;
+
+	if (IsPipelinedActive()) {
+		PipelinePose.CopyBonesFrom(Output.Pose);
+		bHasPipelinePose = true;
+	}
 
 	if (!isRunning) {
 		Output.ResetToRefPose();
 		return;
 	}
 
-	if (ModelData != nullptr && !isModelInitialized) {
-		InitializeModel(ModelData);
+	// The source pose is passed through until the model has been created
+	if (!isModelInitialized) {
+		return;
 	}
 
 	float deltaTime = Output.AnimInstanceProxy->GetDeltaSeconds();
+	TimeSinceResult += deltaTime;
+
+	int32 EvaluationResult = 0;
+	if (IsPipelinedActive()) {
+		// Join the inference launched in Update, usually it has finished by now
+		if (bPipelinedResultPending) {
+			bPipelinedResultPending = false;
+			if (bPipelinedResultMemoized) {
+				bPipelinedResultMemoized = false;
+				EvaluationResult = ProcessOutput(TimeSinceResult, MemoizedOutput);
+			}
+			else if (PipelinedInference.Get() != 0) {
+				MemoizeOutput(ModelInstance->GetOutputData(0));
+				EvaluationResult = ProcessOutput(TimeSinceResult, ModelInstance->GetOutputData(0));
+			}
+			else {
+				EvaluationResult = -1;
+			}
+		}
+	}
+	else if (FixedStepRate > 0.0f) {
+		EvaluationResult = StepModel(BoneContainer, GetComponentSpacePose(Output.Pose), deltaTime);
+	}
+	else {
+		// The input buffers belong to the running inference until it has finished
+		const bool bIsModelBusy = IsAsyncActive() && AsyncInference.IsValid() && !AsyncInference.IsReady();
+
+		// With a reduced inference rate the features are only computed when the model runs
+		if (IsInferenceDue(TimeSinceResult) && !bIsModelBusy) {
+			if (!PrepareInference(BoneContainer, GetComponentSpacePose(Output.Pose), deltaTime)) {
+				Output.ResetToRefPose();
+				return;
+			}
 
-	TArray<float> FeatureVector = FeatureSet->ComputeFeaturesRealTime(BoneContainer, Output, deltaTime);
-
-	if (FeatureVector.Num() == 0) {
-		Output.ResetToRefPose();
-		return;
+			// Finite difference velocities are taken over the time between results
+			EvaluationResult = EvaluateModel(TimeSinceResult);
+		}
 	}
 
-	int32 EvaluationResult = EvaluateModel(FeatureVector, deltaTime);
+	if (EvaluationResult == 1 || (EvaluationResult == 0 && bHasOutputPose)) {
+		// Between results the last output is applied again, or extrapolated, so the inertialisation keeps running
+		UpdateOutputPose(deltaTime, EvaluationResult == 1);
+		UpdateOutputBoneWeights(deltaTime);
+		bHasOutputPose = true;
 
-	if (EvaluationResult == 1) {
 		if (static_cast<uint8>(FeatureSet->TransformType) & static_cast<uint8>(EFeatureBoneTransformFlags::Local)) {
 			SetLocalBoneTransforms(Output, BoneContainer);
 		}
@@ -85,121 +209,564 @@ void FAnimNode_NN::Evaluate_AnyThread(FPoseContext& Output)
 	}
 }
 
+bool FAnimNode_NN::IsInferenceDue(const float Time) const {
+	return InferenceRate <= 0.0f || !bHasOutputPose || Time >= 1.0f / InferenceRate;
+}
+
+bool FAnimNode_NN::IsAsyncActive() const {
+	return isAsync && !CrowdInference.IsValid() && FixedStepRate <= 0.0f;
+}
+
+bool FAnimNode_NN::IsPipelinedActive() const {
+	return isPipelined && !CrowdInference.IsValid() && FixedStepRate <= 0.0f;
+}
+
+int FAnimNode_NN::StepModel(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& Pose, const float DeltaTime) {
+	const float StepTime = 1.0f / FixedStepRate;
+	StepAccumulator += DeltaTime;
+	StepSampleTime += DeltaTime;
+
+	// The first evaluation steps right away so there is a pose to show
+	int32 NumSteps = bHasOutputPose ? FMath::FloorToInt(StepAccumulator / StepTime) : 1;
+	if (NumSteps > MaxSubSteps) {
+		StepAccumulator -= (NumSteps - MaxSubSteps) * StepTime;
+		NumSteps = MaxSubSteps;
+	}
+	if (NumSteps == 0) {
+		StepAlpha = FMath::Clamp(StepAccumulator / StepTime, 0.0f, 1.0f);
+		return 0;
+	}
+
+	// Every due step is consumed, only the leftover time is carried to the next evaluation
+	StepAccumulator = FMath::Max(StepAccumulator - NumSteps * StepTime, 0.0f);
+
+	// The features are taken once per source pose, over the time since they were last taken, so their velocities stay valid
+	if (!PrepareInference(BoneContainer, Pose, StepSampleTime)) {
+		return -1;
+	}
+	const float SampleTime = StepSampleTime;
+	StepSampleTime = 0.0f;
+
+	// Without a recurrent state more steps on the same features return the same result, so one step covers all that are due
+	// A recurrent model advances its state on every step, the later steps reuse the features already in the input tensors
+	const bool bIsRecurrent = StateTensors.Num() > 0;
+	const int32 NumInferences = bIsRecurrent ? NumSteps : 1;
+
+	int Result = 0;
+	for (int32 Step = 0; Step < NumInferences; Step++) {
+		StepPreviousPositions = BonePositions;
+		StepPreviousRotations = BoneRotations;
+
+		Result = EvaluateModel(bIsRecurrent ? StepTime : SampleTime);
+		if (Result < 0) {
+			return Result;
+		}
+	}
+
+	if (!bHasOutputPose && Result == 1) {
+		StepPreviousPositions = BonePositions;
+		StepPreviousRotations = BoneRotations;
+	}
+	StepAlpha = FMath::Clamp(StepAccumulator / StepTime, 0.0f, 1.0f);
+	return Result;
+}
+
+FCSPose<FCompactHeapPose>& FAnimNode_NN::GetComponentSpacePose(const FCompactPose& Pose) {
+	// Filled once per evaluation, the component space transforms themselves are only computed for the bones that are asked for
+	if (!bIsComponentSpacePoseValid) {
+		ComponentSpaceSourcePose.CopyBonesFrom(Pose);
+		ComponentSpacePose.InitPose(ComponentSpaceSourcePose);
+		bIsComponentSpacePoseValid = true;
+	}
+	return ComponentSpacePose;
+}
+
+bool FAnimNode_NN::PrepareInference(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& Pose, const float DeltaTime) {
+	if (FeatureInputIndices.Num() != FeatureSet->GetFeatures().Num()) {
+		BindFeatureInputs();
+	}
+
+	if (bStateResetPending || isStateReset) {
+		ModelInstance->ResetStates();
+		bStateResetPending = false;
+	}
+
+	return FeatureSet->ComputeFeaturesRealTime(BoneContainer, Pose, DeltaTime, FeatureInputIndices, InputTensorViews);
+}
+
 void FAnimNode_NN::GatherDebugData(FNodeDebugData& DebugData)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_ANIMNODE(GatherDebugData)
 	FString DebugLine = DebugData.GetNodeName(this);
+	if (InferenceCache.IsValid()) {
+		DebugLine += FString::Printf(TEXT("(Memoized: %lld hits, %lld misses)"), InferenceCache->NumHits(), InferenceCache->NumMisses());
+	}
+	if (CrowdInference.IsValid()) {
+		DebugLine += FString::Printf(TEXT("(Crowd: %d clusters, %d characters)"), CrowdInference->NumClusters(), CrowdInference->NumMembers());
+	}
 	DebugData.AddDebugItem(DebugLine);
 	Source.GatherDebugData(DebugData);
 }
 
 void FAnimNode_NN::InitializeModel(TObjectPtr<UNNEModelData> modelData) {
-	TWeakInterfacePtr<INNERuntimeCPU> Runtime = UE::NNE::GetRuntime<INNERuntimeCPU>(FString("NNERuntimeORTCpu"));
-	if (Runtime.IsValid()) {
-		if (ModelData) {
-			ModelInstance = MakeShared<FModelInstance>();
-			ModelInstance->Initialize(modelData, Runtime);
+	// The model is created on a background thread, a previous model keeps running until it is ready
+	PendingModelInstance = FModelRegistry::Get().RequestInstance(modelData).Share();
+	PendingModelData = modelData;
+}
+
+void FAnimNode_NN::RequestModelLOD(const FAnimationBaseContext& Context) {
+	const int32 ModelLOD = SelectModelLOD(Context.AnimInstanceProxy->GetLODLevel());
+	UNNEModelData* LODModelData = ModelLOD == 0 ? ModelData.Get() : ModelLODs[ModelLOD - 1].ModelData.Get();
+
+	// Switching LOD goes through the same background creation as a model change, the current model runs until the new one is ready
+	if (LODModelData != nullptr && LODModelData != PendingModelData) {
+		InitializeModel(LODModelData);
+		PendingModelLOD = ModelLOD;
+	}
+}
+
+int32 FAnimNode_NN::SelectModelLOD(const int32 LODLevel) const {
+	if (ModelLODOverride >= 0) {
+		return FMath::Min(ModelLODOverride, ModelLODs.Num());
+	}
 
-			isModelInitialized = true;
+	int32 ModelLOD = 0;
+	for (int32 i = 0; i < ModelLODs.Num(); i++) {
+		if (LODLevel >= ModelLODs[i].MinLODLevel) {
+			ModelLOD = i + 1;
 		}
 	}
+	return ModelLOD;
 }
 
-int FAnimNode_NN::EvaluateModel(TArray<float>& InputData, const float DeltaTime) {
-	if (ModelData != nullptr && !isModelInitialized) {
-		InitializeModel(ModelData);
+void FAnimNode_NN::BindOutputBones(bool bBlend) {
+	const int32 NumOutputBones = FeatureSet->OutputBones.Num();
+	const TArray<FName>* LODOutputBones = ModelLODs.IsValidIndex(ActiveModelLOD - 1) ? &ModelLODs[ActiveModelLOD - 1].OutputBones : nullptr;
+
+	ActiveOutputBones.Reset();
+	OutputBoneMask.Init(false, NumOutputBones);
+	for (int32 i = 0; i < NumOutputBones; i++) {
+		if (LODOutputBones == nullptr || LODOutputBones->Num() == 0 || LODOutputBones->Contains(FeatureSet->OutputBones[i].BoneName)) {
+			ActiveOutputBones.Add(i);
+			OutputBoneMask[i] = true;
+		}
 	}
 
-	if (InputData.Num() == 0)
-	{
-		UE_LOG(LogTemp, Warning, TEXT("InputData is empty"));
-		return -1;
+	// Without a blend the bones switch right away, e.g. for the first model
+	if (!bBlend || OutputBoneWeights.Num() != NumOutputBones) {
+		OutputBoneWeights.SetNum(NumOutputBones);
+		for (int32 i = 0; i < NumOutputBones; i++) {
+			OutputBoneWeights[i] = OutputBoneMask[i] ? 1.0f : 0.0f;
+		}
+	}
+	bHasLODResult = false;
+}
+
+void FAnimNode_NN::UpdateOutputBoneWeights(const float DeltaTime) {
+	// Bones the new model adds only blend in once it has output them
+	if (!bHasLODResult) {
+		return;
+	}
+
+	const float Step = ModelLODBlendTime > 0.0f ? DeltaTime / ModelLODBlendTime : 1.0f;
+	for (int32 i = 0; i < OutputBoneWeights.Num(); i++) {
+		OutputBoneWeights[i] = FMath::Clamp(OutputBoneWeights[i] + (OutputBoneMask[i] ? Step : -Step), 0.0f, 1.0f);
+	}
+}
+
+void FAnimNode_NN::UpdatePendingModel() {
+	// A pipelined result has to be collected from the instance that computed it, an asynchronous one has to have finished with its buffers
+	const bool bIsAsyncInferenceRunning = AsyncInference.IsValid() && !AsyncInference.IsReady();
+	if (bPipelinedResultPending || bIsAsyncInferenceRunning || !PendingModelInstance.IsValid() || !PendingModelInstance.IsReady()) {
+		return;
+	}
+
+	TSharedPtr<FModelInstance> NewModelInstance = PendingModelInstance.Get();
+	PendingModelInstance = TSharedFuture<TSharedPtr<FModelInstance>>();
+
+	if (NewModelInstance.IsValid()) {
+		// A finished asynchronous result of the old model is dropped
+		ModelInstance = NewModelInstance;
+		AsyncInference = TSharedFuture<int32>();
+
+		// Swapping the model makes the output jump
+		bOutputDiscontinuity = isModelInitialized;
+		InitializedModelData = PendingModelData;
+		ActiveModelLOD = PendingModelLOD;
+		BindOutputBones(isModelInitialized);
+		isModelInitialized = true;
+		BindFeatureInputs();
+		ModelInstance->BindStates(StateTensors);
+		BindInferenceCache();
+		BindCrowdInference();
+	}
+}
+
+void FAnimNode_NN::ResetModelState() {
+	bStateResetPending = true;
+}
+
+int64 FAnimNode_NN::GetMemoizationHits() const {
+	return InferenceCache.IsValid() ? InferenceCache->NumHits() : 0;
+}
+
+int64 FAnimNode_NN::GetMemoizationMisses() const {
+	return InferenceCache.IsValid() ? InferenceCache->NumMisses() : 0;
+}
+
+void FAnimNode_NN::BindInferenceCache() {
+	bInferenceCacheKeyPending = false;
+
+	// The recurrent state makes the output differ for the same features
+	if (!isMemoized || StateTensors.Num() > 0) {
+		InferenceCache.Reset();
+		return;
+	}
+
+	// Outputs of the previous model do not apply to the new one
+	if (isMemoizationShared) {
+		InferenceCache = FInferenceCache::GetShared(InitializedModelData, MemoizationTolerance, MemoizationCapacity);
+	}
+	else {
+		InferenceCache = MakeShared<FInferenceCache>(MemoizationTolerance, MemoizationCapacity);
+	}
+}
+
+bool FAnimNode_NN::FindMemoizedOutput() {
+	bInferenceCacheKeyPending = false;
+	if (!InferenceCache.IsValid()) {
+		return false;
+	}
+
+	InferenceCacheKey = InferenceCache->ComputeKey(InputTensorViews);
+	if (InferenceCache->Find(InferenceCacheKey, MemoizedOutput)) {
+		return true;
+	}
+
+	// The inference that runs instead adds its output in MemoizeOutput
+	bInferenceCacheKeyPending = true;
+	return false;
+}
+
+void FAnimNode_NN::MemoizeOutput(TConstArrayView<float> OutputData) {
+	if (bInferenceCacheKeyPending && InferenceCache.IsValid() && OutputData.Num() > 0) {
+		InferenceCache->Add(InferenceCacheKey, OutputData);
+	}
+	bInferenceCacheKeyPending = false;
+}
+
+void FAnimNode_NN::BindCrowdInference() {
+	// Every character keeps its own recurrent state, so it cannot share an output
+	if (!isCrowdShared || StateTensors.Num() > 0) {
+		CrowdInference.Reset();
+		return;
+	}
+
+	CrowdInference = FCrowdInference::Get(InitializedModelData, CrowdClusterSize);
+}
+
+void FAnimNode_NN::BindFeatureInputs() {
+	TArray<FString> InputNames;
+	InputTensorViews.Reset();
+	for (int32 i = 0; i < ModelInstance->NumInputs(); i++) {
+		InputNames.Add(ModelInstance->Inputs[i].Name);
+		InputTensorViews.Add(ModelInstance->GetInputData(i));
 	}
+	FeatureInputIndices = FeatureSet->GetFeatureInputIndices(InputNames);
+}
 
-	if (isAsync) {
-		if (!ModelInstance->bIsRunning) {
-			if (ModelInstance->bIsFinished) {
-				ModelInstance->bIsFinished = false;
-				return ProcessOutput(DeltaTime);
+int FAnimNode_NN::EvaluateModel(const float DeltaTime) {
+	if (IsAsyncActive()) {
+		// Collected once the inference thread has fulfilled the future, without waiting for the game thread
+		if (AsyncInference.IsValid()) {
+			if (!AsyncInference.IsReady()) {
+				return 0;
 			}
 
-			ModelInstance->bIsRunning = true;
-			TSharedPtr<FModelInstance> ModelInstancePtr = ModelInstance;
-			TArray<float> InputDataCopy = InputData;
-			AsyncTask(ENamedThreads::AnyNormalThreadNormalTask, [ModelInstancePtr, InputDataCopy]()
-				{
-					if (ModelInstancePtr->RunModel(InputDataCopy) != 0)
-					{
-						//UE_LOG(LogTemp, Error, TEXT("Failed to run the model"));
-					}
-					AsyncTask(ENamedThreads::GameThread, [ModelInstancePtr]()
-						{
-							ModelInstancePtr->bIsRunning = false;
-							ModelInstancePtr->bIsFinished = true;
-							//UE_LOG(LogTemp, Warning, TEXT("Model Run Successfully"))
-						});
-				});
-			return 0;
+			const int32 RunResult = AsyncInference.Get();
+			AsyncInference = TSharedFuture<int32>();
+			if (RunResult == 0) {
+				UE_LOG(LogTemp, Warning, TEXT("ModelInstance->RunModel() == 0"));
+				return -1;
+			}
+			MemoizeOutput(ModelInstance->GetOutputData(0));
+			return ProcessOutput(DeltaTime, ModelInstance->GetOutputData(0));
+		}
+
+		if (FindMemoizedOutput()) {
+			return ProcessOutput(DeltaTime, MemoizedOutput);
 		}
-		return 0;
 
+		// The features have been written to the input buffers, which the task reads in place
+		TSharedPtr<FModelInstance> ModelInstancePtr = ModelInstance;
+		AsyncInference = FInferenceExecutor::Get().Launch([ModelInstancePtr]()
+			{
+				return ModelInstancePtr->RunModel();
+			}).Share();
+		return 0;
 	}
 	else {
-		if (ModelInstance->RunModel(InputData) == 0) {
-			UE_LOG(LogTemp, Warning, TEXT("ModelInstance->RunModel(InputData) == 0"));
+		if (FindMemoizedOutput()) {
+			return ProcessOutput(DeltaTime, MemoizedOutput);
+		}
+
+		if (CrowdInference.IsValid()) {
+			return EvaluateCrowdModel(DeltaTime);
+		}
+
+		if (ModelInstance->RunModel() == 0) {
+			UE_LOG(LogTemp, Warning, TEXT("ModelInstance->RunModel() == 0"));
 			return -1;
 		}
-		return ProcessOutput(DeltaTime);
+		MemoizeOutput(ModelInstance->GetOutputData(0));
+		return ProcessOutput(DeltaTime, ModelInstance->GetOutputData(0));
 	}
 
 	return -1;
 }
 
-void FAnimNode_NN::SetLocalBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer) {
-	for (int i = 0; i < FeatureSet->OutputBones.Num(); i++) {
-		const FCompactPoseBoneIndex CompactPoseBoneIndex = FeatureSet->OutputBones[i].GetCompactPoseIndex(BoneContainer);
-		if (CompactPoseBoneIndex != INDEX_NONE) {
-			FTransform& BoneTransform = Output.Pose[CompactPoseBoneIndex];
-			BoneTransform.SetLocation(BonePositions[i]);
+int FAnimNode_NN::EvaluateCrowdModel(const float DeltaTime) {
+	const uint64 ClusterKey = CrowdInference->ComputeClusterKey(InputTensorViews);
+
+	// Usually another member started the inference earlier in the frame and it has finished by now
+	TSharedFuture<TArray<float>> ClusterOutput = CrowdInference->Join(ClusterKey, ModelInstance);
+	const TArray<float>& OutputData = ClusterOutput.Get();
+	if (OutputData.Num() == 0) {
+		UE_LOG(LogTemp, Warning, TEXT("Crowd inference failed"));
+		return -1;
+	}
+
+	// Moving to another cluster makes the output jump, the inertialisation hides it
+	bOutputDiscontinuity |= bHasOutputPose && ClusterKey != CrowdClusterKey;
+	CrowdClusterKey = ClusterKey;
+
+	MemoizeOutput(OutputData);
+	return ProcessOutput(DeltaTime, OutputData);
+}
+
+void FAnimNode_NN::UpdateOutputPose(const float DeltaTime, bool bNewResult) {
+	const bool bDiscontinuity = bNewResult && (bOutputDiscontinuity || IsAsyncActive());
+
+	if (bNewResult) {
+		for (int i = 0; i < BoneRotations.Num(); i++) {
 			BoneRotations[i].Normalize();
-			BoneTransform.SetRotation(BoneRotations[i]);
-			if (isInertialised) {
-				Inertializers[i].Update(BoneTransform, Output.AnimInstanceProxy->GetDeltaSeconds());
+		}
+
+		if (isInertialised && InertialisationMode == EInertialisationMode::SavitzkyGolay && ResultFilter.Num() == BonePositions.Num() * 7) {
+			FilterResult(TimeSinceResult);
+		}
+
+		// The pose shown so far keeps moving with its old velocities while the new result blends in
+		if (isExtrapolated && FixedStepRate <= 0.0f && bHasOutputPose) {
+			Extrapolation.Evaluate(FMath::Min(TimeSinceResult, MaxExtrapolationTime), BlendSource.Positions, BlendSource.Rotations);
+			BlendSource.Velocities = Extrapolation.Velocities;
+			BlendSource.AngularVelocities = Extrapolation.AngularVelocities;
+		}
+
+		Extrapolation.Positions = BonePositions;
+		Extrapolation.Rotations = BoneRotations;
+		Extrapolation.Velocities = BoneVelocities;
+		Extrapolation.AngularVelocities = BoneAngularVelocities;
+		TimeSinceResult = 0.0f;
+		bOutputDiscontinuity = false;
+	}
+
+	if (FixedStepRate > 0.0f) {
+		// The shown pose lags one step behind the model, interpolated between its last two results
+		for (int i = 0; i < OutputPositions.Num(); i++) {
+			OutputPositions[i] = FMath::Lerp(StepPreviousPositions[i], Extrapolation.Positions[i], StepAlpha);
+			OutputRotations[i] = FQuat::Slerp(StepPreviousRotations[i], Extrapolation.Rotations[i], StepAlpha);
+		}
+	}
+	else if (isExtrapolated) {
+		const float ExtrapolationTime = FMath::Min(TimeSinceResult, MaxExtrapolationTime);
+		Extrapolation.Evaluate(ExtrapolationTime, OutputPositions, OutputRotations);
+
+		if (bHasOutputPose && TimeSinceResult < ExtrapolationBlendTime) {
+			const float Alpha = FMath::SmoothStep(0.0f, 1.0f, TimeSinceResult / ExtrapolationBlendTime);
+			BlendSource.Evaluate(ExtrapolationTime, BlendSourcePositions, BlendSourceRotations);
+			for (int i = 0; i < OutputPositions.Num(); i++) {
+				OutputPositions[i] = FMath::Lerp(BlendSourcePositions[i], OutputPositions[i], Alpha);
+				OutputRotations[i] = FQuat::Slerp(BlendSourceRotations[i], OutputRotations[i], Alpha);
+			}
+		}
+	}
+	else {
+		OutputPositions = Extrapolation.Positions;
+		OutputRotations = Extrapolation.Rotations;
+	}
+
+	if (!isInertialised) {
+		return;
+	}
+
+	switch (InertialisationMode)
+	{
+		case EInertialisationMode::Offset:
+		{
+			if (OffsetInertializer.Num() == OutputPositions.Num()) {
+				OffsetInertializer.Update(OutputPositions, OutputRotations, DeltaTime, bDiscontinuity);
+			}
+			break;
+		}
+		case EInertialisationMode::SavitzkyGolay:
+		{
+			// Already applied to each new result in FilterResult
+			break;
+		}
+		case EInertialisationMode::Spring:
+		{
+			// All output bones are inertialised together in one batch
+			if (Inertializer.Num() == OutputPositions.Num()) {
+				Inertializer.Update(OutputPositions, OutputRotations, DeltaTime);
 			}
+			break;
 		}
 	}
 }
 
-void FAnimNode_NN::SetComponentSpaceBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer) {
+void FAnimNode_NN::FilterResult(const float ResultDeltaTime) {
+	const int32 NumBones = BonePositions.Num();
+	ResultFilterChannels.SetNum(NumBones * 7);
 
-	FCSPose<FCompactPose> ComponentSpacePose;
-	ComponentSpacePose.InitPose(Output.Pose);
+	for (int i = 0; i < NumBones; i++) {
+		// Keep the quaternions in the same hemisphere as the last result so their components can be filtered
+		FQuat Rotation = BoneRotations[i];
+		if (bHasOutputPose && (Rotation | Extrapolation.Rotations[i]) < 0) {
+			Rotation = Rotation * -1.0f;
+		}
 
-	for (int i = 0; i < FeatureSet->OutputBones.Num(); i++) {
-		const FCompactPoseBoneIndex CompactPoseBoneIndex = FeatureSet->OutputBones[i].GetCompactPoseIndex(BoneContainer);
-		if (CompactPoseBoneIndex != INDEX_NONE) {
-			FTransform BoneTransform = ComponentSpacePose.GetComponentSpaceTransform(CompactPoseBoneIndex);
-			BoneTransform.SetLocation(BonePositions[i]);
-			BoneRotations[i].Normalize();
-			BoneTransform.SetRotation(BoneRotations[i]);
-			if (isInertialised) {
-				Inertializers[i].Update(BoneTransform, Output.AnimInstanceProxy->GetDeltaSeconds());
-			}
-			ComponentSpacePose.SetComponentSpaceTransform(CompactPoseBoneIndex, BoneTransform);
+		float* Channels = ResultFilterChannels.GetData() + i * 7;
+		Channels[0] = BonePositions[i].X;
+		Channels[1] = BonePositions[i].Y;
+		Channels[2] = BonePositions[i].Z;
+		Channels[3] = Rotation.X;
+		Channels[4] = Rotation.Y;
+		Channels[5] = Rotation.Z;
+		Channels[6] = Rotation.W;
+	}
+
+	ResultFilter.Update(ResultFilterChannels, ResultDeltaTime, &ResultFilterDerivatives);
+
+	const bool bVelocitiesFromModel = FeatureSet->bGetVelocitiesFromModelOutput;
+	for (int i = 0; i < NumBones; i++) {
+		const float* Channels = ResultFilterChannels.GetData() + i * 7;
+		const float* Derivatives = ResultFilterDerivatives.GetData() + i * 7;
+
+		BonePositions[i] = FVector(Channels[0], Channels[1], Channels[2]);
+		BoneRotations[i] = FQuat(Channels[3], Channels[4], Channels[5], Channels[6]);
+		BoneRotations[i].Normalize();
+
+		// Smoothed velocities from the derivative of the fit, angular velocity is 2 * dq/dt * q^-1
+		if (!bVelocitiesFromModel && bHasOutputPose) {
+			BoneVelocities[i] = FVector(Derivatives[0], Derivatives[1], Derivatives[2]);
+			const FQuat RotationDerivative(Derivatives[3], Derivatives[4], Derivatives[5], Derivatives[6]);
+			const FQuat AngularVelocity = RotationDerivative * BoneRotations[i].Inverse();
+			BoneAngularVelocities[i] = 2.0f * FVector(AngularVelocity.X, AngularVelocity.Y, AngularVelocity.Z);
+		}
+	}
+}
+
+void FAnimNode_NN::CacheOutputBones(const FBoneContainer& BoneContainer) {
+	const int32 NumBones = BoneContainer.GetCompactPoseNumBones();
+	TBitArray<> IsWrittenBack(false, NumBones);
+
+	OutputBoneIndices.Reset(FeatureSet->OutputBones.Num());
+	for (FBoneReference& BoneReference : FeatureSet->OutputBones) {
+		const FCompactPoseBoneIndex BoneIndex = BoneReference.GetCompactPoseIndex(BoneContainer);
+		OutputBoneIndices.Add(BoneIndex);
+
+		// The component space transform of a bone needs the whole chain up to the root
+		for (FCompactPoseBoneIndex Index = BoneIndex; Index != INDEX_NONE && !IsWrittenBack[Index.GetInt()]; Index = BoneContainer.GetParentBoneIndex(Index)) {
+			IsWrittenBack[Index.GetInt()] = true;
+		}
+	}
+
+	TArray<int32> BoneSlots;
+	BoneSlots.Init(INDEX_NONE, NumBones);
+	WriteBackBones.Reset();
+	WriteBackParents.Reset();
+	WriteBackOutputBones.Reset();
+	for (TConstSetBitIterator<> It(IsWrittenBack); It; ++It) {
+		const FCompactPoseBoneIndex BoneIndex(It.GetIndex());
+		const FCompactPoseBoneIndex ParentIndex = BoneContainer.GetParentBoneIndex(BoneIndex);
+		BoneSlots[BoneIndex.GetInt()] = WriteBackBones.Add(BoneIndex);
+		WriteBackParents.Add(ParentIndex != INDEX_NONE ? BoneSlots[ParentIndex.GetInt()] : INDEX_NONE);
+		WriteBackOutputBones.Add(INDEX_NONE);
+	}
+	for (int32 i = 0; i < OutputBoneIndices.Num(); i++) {
+		if (OutputBoneIndices[i] != INDEX_NONE) {
+			WriteBackOutputBones[BoneSlots[OutputBoneIndices[i].GetInt()]] = i;
 		}
 	}
 
-	FCSPose<FCompactPose>::ConvertComponentPosesToLocalPoses(ComponentSpacePose, Output.Pose);
+	OutputBonesSerialNumber = BoneContainer.GetSerialNumber();
 }
 
-int FAnimNode_NN::ProcessOutput(const float DeltaTime) {
-	TArray<float> output = ModelInstance->OutputData;
+void FAnimNode_NN::SetLocalBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer) {
+	if (OutputBonesSerialNumber != BoneContainer.GetSerialNumber() || OutputBoneIndices.Num() != FeatureSet->OutputBones.Num()) {
+		CacheOutputBones(BoneContainer);
+	}
+
+	for (int i = 0; i < OutputBoneIndices.Num(); i++) {
+		// Bones the current model LOD does not output keep the source pose
+		const float Weight = OutputBoneWeights.IsValidIndex(i) ? OutputBoneWeights[i] : 1.0f;
+		const FCompactPoseBoneIndex CompactPoseBoneIndex = OutputBoneIndices[i];
+		if (CompactPoseBoneIndex != INDEX_NONE && Weight > 0.0f) {
+			FTransform& BoneTransform = Output.Pose[CompactPoseBoneIndex];
+			BoneTransform.SetLocation(FMath::Lerp(BoneTransform.GetLocation(), OutputPositions[i], Weight));
+			BoneTransform.SetRotation(FQuat::Slerp(BoneTransform.GetRotation(), OutputRotations[i], Weight));
+		}
+	}
+}
+
+void FAnimNode_NN::SetComponentSpaceBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer) {
+	if (OutputBonesSerialNumber != BoneContainer.GetSerialNumber() || OutputBoneIndices.Num() != FeatureSet->OutputBones.Num()) {
+		CacheOutputBones(BoneContainer);
+	}
+
+	// Only the output bones and their ancestors go through component space, like the bones a full FCSPose conversion computes in component space
+	// Ancestors that are not driven keep their source component space transform, every other bone keeps its local transform and follows its parent
+	// Transforms the features already computed are reused
+	FCSPose<FCompactHeapPose>& SourcePose = GetComponentSpacePose(Output.Pose);
+	const int32 NumWriteBackBones = WriteBackBones.Num();
+	WriteBackTransforms.SetNum(NumWriteBackBones, false);
+	WriteBackMoved.Init(false, NumWriteBackBones);
+
+	for (int32 Slot = 0; Slot < NumWriteBackBones; Slot++) {
+		FTransform& LocalTransform = Output.Pose[WriteBackBones[Slot]];
+		const int32 ParentSlot = WriteBackParents[Slot];
+		const bool bIsParentMoved = ParentSlot != INDEX_NONE && WriteBackMoved[ParentSlot];
+
+		const int32 i = WriteBackOutputBones[Slot];
+		const float Weight = i == INDEX_NONE ? 0.0f : OutputBoneWeights.IsValidIndex(i) ? OutputBoneWeights[i] : 1.0f;
+		if (Weight <= 0.0f) {
+			// Its local transform only changes if the parent moved
+			WriteBackTransforms[Slot] = SourcePose.GetComponentSpaceTransform(WriteBackBones[Slot]);
+			if (bIsParentMoved) {
+				LocalTransform = WriteBackTransforms[Slot].GetRelativeTransform(WriteBackTransforms[ParentSlot]);
+			}
+			continue;
+		}
+
+		FTransform BoneTransform = SourcePose.GetComponentSpaceTransform(WriteBackBones[Slot]);
+		BoneTransform.SetLocation(FMath::Lerp(BoneTransform.GetLocation(), OutputPositions[i], Weight));
+		BoneTransform.SetRotation(FQuat::Slerp(BoneTransform.GetRotation(), OutputRotations[i], Weight));
+		WriteBackTransforms[Slot] = BoneTransform;
+		WriteBackMoved[Slot] = true;
+		LocalTransform = ParentSlot != INDEX_NONE ? BoneTransform.GetRelativeTransform(WriteBackTransforms[ParentSlot]) : BoneTransform;
+	}
+}
+
+int FAnimNode_NN::ProcessOutput(const float DeltaTime, TConstArrayView<float> OutputData) {
+	TConstArrayView<float> output = OutputData;
 	if (output.Num() == 0) {
 		UE_LOG(LogTemp, Warning, TEXT("OutputData is empty"));
 		return -1;
 	}
 
-	if (output.Num() != FeatureSet->GetOutputVectorSize()) {
+	// Cheaper model LODs only output a subset of the output bones
+	if (output.Num() != FeatureSet->GetOutputBoneVectorSize() * ActiveOutputBones.Num()) {
 		UE_LOG(LogTemp, Warning, TEXT("Output format does not match database size"));
 		return -1;
 	}
@@ -209,20 +776,37 @@ int FAnimNode_NN::ProcessOutput(const float DeltaTime) {
 		return -1;
 	}
 
+	// Only the output smoothing needs a copy, it works on it in place. The buffer is kept so it is allocated once
+	if (isOutputSmoothed) {
+		if (OutputSmoothing.Num() != output.Num()) {
+			OutputSmoothing.Initialize(output.Num());
+		}
+		SmoothedOutput.Reset();
+		SmoothedOutput.Append(OutputData.GetData(), OutputData.Num());
+		OutputSmoothing.Update(SmoothedOutput, DeltaTime);
+		output = SmoothedOutput;
+	}
+
 	int outputIndex = 0;
-	for (int i = 0; i < FeatureSet->OutputBones.Num(); i++) {
+	for (const int32 i : ActiveOutputBones) {
 		if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Position))
 		{
 			FVector NewPosition = FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]);
 			outputIndex += 3;
 
-			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Velocity))
+			const bool bHasVelocity = static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Velocity);
+			if (bHasVelocity && FeatureSet->bGetVelocitiesFromModelOutput)
 			{
-				if (FeatureSet->bGetVelocitiesFromModelOutput) {
-					BoneVelocities[i] = FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]);
-					outputIndex += 3;
+				BoneVelocities[i] = FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]);
+				outputIndex += 3;
+			}
+			else if (bHasVelocity || isExtrapolated)
+			{
+				// Without time between the results the finite difference is undefined, the previous velocity is kept
+				if (!bHasOutputPose) {
+					BoneVelocities[i] = FVector::ZeroVector;
 				}
-				else {
+				else if (DeltaTime > KINDA_SMALL_NUMBER) {
 					BoneVelocities[i] = (NewPosition - BonePositions[i]) / DeltaTime;
 				}
 			}
@@ -239,23 +823,29 @@ int FAnimNode_NN::ProcessOutput(const float DeltaTime) {
 				{
 					NewRotation = FQuat(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2], output[outputIndex + 3]);
 					outputIndex += 4;
+					break;
 				}
 				case ERotationFormat::XFormXY:
 				{
 					NewRotation = UFeatureComputation::GetQuatFromXformXY(FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]), FVector(output[outputIndex + 3], output[outputIndex + 4], output[outputIndex + 5]));
 					outputIndex += 6;
+					break;
 				}
 			}
 
-			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::AngularVelocity))
+			const bool bHasAngularVelocity = static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::AngularVelocity);
+			if (bHasAngularVelocity && FeatureSet->bGetVelocitiesFromModelOutput)
 			{
-				if (FeatureSet->bGetVelocitiesFromModelOutput)
-				{
-					BoneAngularVelocities[i] = FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]);
-					outputIndex += 3;
+				BoneAngularVelocities[i] = FVector(output[outputIndex], output[outputIndex + 1], output[outputIndex + 2]);
+				outputIndex += 3;
+			}
+			else if (bHasAngularVelocity || isExtrapolated)
+			{
+				NewRotation.Normalize();
+				if (!bHasOutputPose) {
+					BoneAngularVelocities[i] = FVector::ZeroVector;
 				}
-				else
-				{
+				else if (DeltaTime > KINDA_SMALL_NUMBER) {
 					BoneAngularVelocities[i] = UFeatureComputation::QuatToScaledAngleAxis(NewRotation * BoneRotations[i].Inverse()) / DeltaTime;
 				}
 			}
@@ -263,5 +853,6 @@ int FAnimNode_NN::ProcessOutput(const float DeltaTime) {
 			BoneRotations[i] = NewRotation;
 		}
 	}
+	bHasLODResult = true;
 	return 1;
 }
\ No newline at end of file
@@ -1,4 +1,195 @@
 #include "BinaryBuilder.h"
+#include "HAL/FileManager.h"
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "Math/Float16.h"
+#include "Misc/Compression.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+    // Shards still being encoded and compressed while the next one is filled, each holds RowsPerShard rows
+    constexpr int32 MaxPendingShards = 4;
+
+    const TCHAR* EncodingToString(EBinaryEncoding Encoding)
+    {
+        switch (Encoding)
+        {
+            case EBinaryEncoding::Float16: return TEXT("float16");
+            case EBinaryEncoding::Quantized16: return TEXT("quantized16");
+            case EBinaryEncoding::Quantized8: return TEXT("quantized8");
+            default: return TEXT("float32");
+        }
+    }
+
+    EBinaryEncoding EncodingFromString(const FString& Encoding)
+    {
+        if (Encoding == TEXT("float16")) return EBinaryEncoding::Float16;
+        if (Encoding == TEXT("quantized16")) return EBinaryEncoding::Quantized16;
+        if (Encoding == TEXT("quantized8")) return EBinaryEncoding::Quantized8;
+        return EBinaryEncoding::Float32;
+    }
+
+    const TCHAR* CompressionToString(EBinaryCompression Compression)
+    {
+        switch (Compression)
+        {
+            case EBinaryCompression::LZ4: return TEXT("lz4");
+            case EBinaryCompression::Zlib: return TEXT("zlib");
+            case EBinaryCompression::Oodle: return TEXT("oodle");
+            default: return TEXT("none");
+        }
+    }
+
+    EBinaryCompression CompressionFromString(const FString& Compression)
+    {
+        if (Compression == TEXT("lz4")) return EBinaryCompression::LZ4;
+        if (Compression == TEXT("zlib")) return EBinaryCompression::Zlib;
+        if (Compression == TEXT("oodle")) return EBinaryCompression::Oodle;
+        return EBinaryCompression::None;
+    }
+
+    float GetQuantizedMax(EBinaryEncoding Encoding)
+    {
+        return Encoding == EBinaryEncoding::Quantized16 ? 65535.0f : 255.0f;
+    }
+
+    int32 GetEncodedElementSize(EBinaryEncoding Encoding)
+    {
+        switch (Encoding)
+        {
+            case EBinaryEncoding::Float16: return sizeof(uint16);
+            case EBinaryEncoding::Quantized16: return sizeof(uint16);
+            case EBinaryEncoding::Quantized8: return sizeof(uint8);
+            default: return sizeof(float);
+        }
+    }
+
+    template <typename T>
+    void Quantize(const float* Source, int64 Count, int32 RowSize, const TArray<float>& Scale, const TArray<float>& Offset, float MaxValue, TArray<uint8>& OutRaw)
+    {
+        OutRaw.SetNumUninitialized(Count * sizeof(T));
+        T* Destination = reinterpret_cast<T*>(OutRaw.GetData());
+        for (int64 i = 0; i < Count; i++)
+        {
+            const int32 Column = i % RowSize;
+            Destination[i] = static_cast<T>(FMath::Clamp(FMath::RoundToFloat((Source[i] - Offset[Column]) / Scale[Column]), 0.0f, MaxValue));
+        }
+    }
+
+    template <typename T>
+    void Dequantize(const uint8* Raw, int64 Count, int32 RowSize, const TArray<float>& Scale, const TArray<float>& Offset, float* Destination)
+    {
+        const T* Source = reinterpret_cast<const T*>(Raw);
+        for (int64 i = 0; i < Count; i++)
+        {
+            const int32 Column = i % RowSize;
+            Destination[i] = static_cast<float>(Source[i]) * Scale[Column] + Offset[Column];
+        }
+    }
+
+    FString GetShardPath(const FString& FilePath, int32 ShardIndex)
+    {
+        return FilePath + FString::Printf(TEXT(".%05d.bin"), ShardIndex);
+    }
+
+    // Encodes, compresses and writes the rows of a single shard, quantized encodings map each column between its min and max within the shard
+    TOptional<FBinaryShard> WriteShard(const FString& ShardPath, const FString& TempSuffix, const TArray<float>& Data, int32 FirstRow, int32 RowSize,
+        EBinaryEncoding Encoding, EBinaryCompression Compression)
+    {
+        FBinaryShard Shard;
+        Shard.FileName = FPaths::GetCleanFilename(ShardPath);
+        Shard.FirstRow = FirstRow;
+        Shard.NumRows = Data.Num() / RowSize;
+
+        const float* Source = Data.GetData();
+        const int64 Count = Data.Num();
+
+        if (Encoding == EBinaryEncoding::Quantized16 || Encoding == EBinaryEncoding::Quantized8)
+        {
+            TArray<float> MaxValues;
+            Shard.Offset.Init(TNumericLimits<float>::Max(), RowSize);
+            MaxValues.Init(TNumericLimits<float>::Lowest(), RowSize);
+            for (int64 i = 0; i < Count; i++)
+            {
+                const int32 Column = i % RowSize;
+                Shard.Offset[Column] = FMath::Min(Shard.Offset[Column], Source[i]);
+                MaxValues[Column] = FMath::Max(MaxValues[Column], Source[i]);
+            }
+
+            Shard.Scale.SetNum(RowSize);
+            for (int32 Column = 0; Column < RowSize; Column++)
+            {
+                const float Range = MaxValues[Column] - Shard.Offset[Column];
+                Shard.Scale[Column] = Range > 0.0f ? Range / GetQuantizedMax(Encoding) : 1.0f;
+            }
+        }
+
+        TArray<uint8> Raw;
+        switch (Encoding)
+        {
+            case EBinaryEncoding::Float16:
+            {
+                Raw.SetNumUninitialized(Count * sizeof(uint16));
+                uint16* Destination = reinterpret_cast<uint16*>(Raw.GetData());
+                for (int64 i = 0; i < Count; i++)
+                {
+                    Destination[i] = FFloat16(Source[i]).Encoded;
+                }
+                break;
+            }
+            case EBinaryEncoding::Quantized16:
+                Quantize<uint16>(Source, Count, RowSize, Shard.Scale, Shard.Offset, GetQuantizedMax(Encoding), Raw);
+                break;
+            case EBinaryEncoding::Quantized8:
+                Quantize<uint8>(Source, Count, RowSize, Shard.Scale, Shard.Offset, GetQuantizedMax(Encoding), Raw);
+                break;
+            default:
+                Raw.Append(reinterpret_cast<const uint8*>(Source), Count * sizeof(float));
+                break;
+        }
+
+        Shard.RawSize = Raw.Num();
+
+        TArray<uint8> Payload;
+        const FName CompressionFormat = UBinaryBuilder::GetCompressionFormat(Compression);
+        if (CompressionFormat.IsNone() || Raw.Num() == 0)
+        {
+            Payload = MoveTemp(Raw);
+        }
+        else
+        {
+            int32 CompressedSize = FCompression::CompressMemoryBound(CompressionFormat, Raw.Num());
+            Payload.SetNumUninitialized(CompressedSize);
+            if (!FCompression::CompressMemory(CompressionFormat, Payload.GetData(), CompressedSize, Raw.GetData(), Raw.Num()))
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to compress %s"), *ShardPath);
+                return TOptional<FBinaryShard>();
+            }
+            Payload.SetNum(CompressedSize);
+        }
+
+        Shard.Size = Payload.Num();
+        if (!FFileHelper::SaveArrayToFile(Payload, *UBinaryBuilder::GetAbsolutePath(ShardPath + TempSuffix)))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to write %s"), *ShardPath);
+            return TOptional<FBinaryShard>();
+        }
+        return Shard;
+    }
+
+    TArray<TSharedPtr<FJsonValue>> MakeNumberValues(TConstArrayView<float> Values)
+    {
+        TArray<TSharedPtr<FJsonValue>> JsonValues;
+        for (float Value : Values)
+        {
+            JsonValues.Add(MakeShared<FJsonValueNumber>(Value));
+        }
+        return JsonValues;
+    }
+}
 
 bool UBinaryBuilder::SaveToBinaryFile(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<float>& Data)
 {
@@ -21,7 +212,7 @@ bool UBinaryBuilder::SaveToBinaryFile(const FString& FilePath, const TArray<int3
         TArray<uint8> RawData;
         RawData.Append(Buffer.GetData(), Buffer.Num());
 
-        return FFileHelper::SaveArrayToFile(RawData, *FPaths::Combine(FPaths::ProjectDir(), FilePath));
+        return FFileHelper::SaveArrayToFile(RawData, *GetAbsolutePath(FilePath));
 }
 
 bool UBinaryBuilder::SaveToBinaryFile(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<int32>& Data)
@@ -45,7 +236,7 @@ bool UBinaryBuilder::SaveToBinaryFile(const FString& FilePath, const TArray<int3
         TArray<uint8> RawData;
         RawData.Append(Buffer.GetData(), Buffer.Num());
 
-        return FFileHelper::SaveArrayToFile(RawData, *FPaths::Combine(FPaths::ProjectDir(), FilePath));
+        return FFileHelper::SaveArrayToFile(RawData, *GetAbsolutePath(FilePath));
 }
 
 TArray<float> UBinaryBuilder::LoadFromBinaryFile(const FString& FilePath)
@@ -58,4 +249,444 @@ TArray<float> UBinaryBuilder::LoadFromBinaryFile(const FString& FilePath)
     FMemory::Memcpy(Data.GetData(), RawData.GetData(), RawData.Num());
 
     return Data;
+}
+
+FString UBinaryBuilder::GetAbsolutePath(const FString& FilePath)
+{
+    return FPaths::IsRelative(FilePath) ? FPaths::Combine(FPaths::ProjectDir(), FilePath) : FilePath;
+}
+
+bool UBinaryBuilder::CommitFile(const FString& TempFilePath, const FString& FilePath)
+{
+    return IFileManager::Get().Move(*GetAbsolutePath(FilePath), *GetAbsolutePath(TempFilePath), true, true);
+}
+
+FName UBinaryBuilder::GetCompressionFormat(EBinaryCompression Compression)
+{
+    switch (Compression)
+    {
+        case EBinaryCompression::LZ4: return NAME_LZ4;
+        case EBinaryCompression::Zlib: return NAME_Zlib;
+        case EBinaryCompression::Oodle: return NAME_Oodle;
+        default: return NAME_None;
+    }
+}
+
+bool UBinaryBuilder::SaveToShardedBinaryFiles(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<float>& Data, int32 RowsPerShard,
+    EBinaryEncoding Encoding, EBinaryCompression Compression, const FString& TempSuffix, TArray<FString>& OutFilePaths)
+{
+    if (Dimensions.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Cannot shard %s without dimensions"), *FilePath);
+        return false;
+    }
+
+    FBinaryFileWriter Writer(FilePath, TArray<int32>(Dimensions.GetData() + 1, Dimensions.Num() - 1), RowsPerShard, Encoding, Compression, TempSuffix);
+    return Writer.Append(Data, Dimensions[0]) && Writer.Finish(OutFilePaths);
+}
+
+FBinaryFileWriter::FBinaryFileWriter(const FString& InFilePath, const TArray<int32>& InRowDimensions, const FString& InTempSuffix)
+    : FilePath(InFilePath)
+    , RowDimensions(InRowDimensions)
+    , TempSuffix(InTempSuffix)
+{
+    for (int32 Dimension : RowDimensions)
+    {
+        RowSize *= Dimension;
+    }
+
+    const FString TempFilePath = UBinaryBuilder::GetAbsolutePath(FilePath + TempSuffix);
+    TempFilePaths.Add(TempFilePath);
+    FileWriter = TUniquePtr<FArchive>(IFileManager::Get().CreateFileWriter(*TempFilePath));
+    if (!FileWriter.IsValid())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to open %s"), *TempFilePath);
+        bFailed = true;
+        return;
+    }
+
+    // The row count is a placeholder until the writer is finished
+    int32 DimensionCount = RowDimensions.Num() + 1;
+    int32 RowCount = 0;
+    *FileWriter << DimensionCount;
+    *FileWriter << RowCount;
+    for (int32 Dimension : RowDimensions)
+    {
+        *FileWriter << Dimension;
+    }
+}
+
+FBinaryFileWriter::FBinaryFileWriter(const FString& InFilePath, const TArray<int32>& InRowDimensions, int32 InRowsPerShard, EBinaryEncoding InEncoding, EBinaryCompression InCompression, const FString& InTempSuffix)
+    : FilePath(InFilePath)
+    , RowDimensions(InRowDimensions)
+    , TempSuffix(InTempSuffix)
+    , bSharded(true)
+    , Encoding(InEncoding)
+    , Compression(InCompression)
+{
+    for (int32 Dimension : RowDimensions)
+    {
+        RowSize *= Dimension;
+    }
+
+    if (RowSize <= 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Cannot shard %s with rows of %d values"), *FilePath, RowSize);
+        bFailed = true;
+        return;
+    }
+
+    // A shard is buffered in a single array before it is written
+    RowsPerShard = FMath::Clamp(InRowsPerShard, 1, MAX_int32 / RowSize);
+    PendingRows.Reserve(RowsPerShard * RowSize);
+}
+
+FBinaryFileWriter::~FBinaryFileWriter()
+{
+    CollectShards(0);
+    FileWriter.Reset();
+
+    if (!bFinished)
+    {
+        for (const FString& TempFilePath : TempFilePaths)
+        {
+            IFileManager::Get().Delete(*TempFilePath, false, false, true);
+        }
+    }
+}
+
+bool FBinaryFileWriter::Append(TConstArrayView<float> Data, int32 InNumRows)
+{
+    if (bFailed || bFinished)
+    {
+        return false;
+    }
+
+    if (InNumRows < 0 || static_cast<int64>(InNumRows) * RowSize != Data.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%d values appended to %s are not %d rows of %d values"), Data.Num(), *FilePath, InNumRows, RowSize);
+        bFailed = true;
+        return false;
+    }
+
+    if (!bSharded)
+    {
+        FileWriter->Serialize(const_cast<float*>(Data.GetData()), static_cast<int64>(Data.Num()) * sizeof(float));
+        NumRows += InNumRows;
+        bFailed = FileWriter->IsError();
+        return !bFailed;
+    }
+
+    int32 Row = 0;
+    while (Row < InNumRows)
+    {
+        const int32 NumCopied = FMath::Min(InNumRows - Row, RowsPerShard - PendingRows.Num() / RowSize);
+        PendingRows.Append(Data.GetData() + static_cast<int64>(Row) * RowSize, NumCopied * RowSize);
+        Row += NumCopied;
+        NumRows += NumCopied;
+
+        if (PendingRows.Num() == RowsPerShard * RowSize)
+        {
+            FlushShard();
+        }
+    }
+
+    return !bFailed;
+}
+
+void FBinaryFileWriter::FlushShard()
+{
+    // Limits the memory held by shards that are still being compressed
+    CollectShards(MaxPendingShards - 1);
+
+    const int32 ShardIndex = NumShards++;
+    const int32 FirstRow = static_cast<int32>(NumRows - PendingRows.Num() / RowSize);
+    const FString ShardPath = GetShardPath(FilePath, ShardIndex);
+    TempFilePaths.Add(UBinaryBuilder::GetAbsolutePath(ShardPath + TempSuffix));
+
+    PendingShards.Add(Async(EAsyncExecution::ThreadPool, [ShardPath, TempSuffix = TempSuffix, Data = MoveTemp(PendingRows), FirstRow, RowSize = RowSize, Encoding = Encoding, Compression = Compression]()
+        {
+            return WriteShard(ShardPath, TempSuffix, Data, FirstRow, RowSize, Encoding, Compression);
+        }));
+
+    PendingRows.Reset();
+    PendingRows.Reserve(RowsPerShard * RowSize);
+}
+
+void FBinaryFileWriter::CollectShards(int32 MaxPendingShards)
+{
+    while (PendingShards.Num() > MaxPendingShards)
+    {
+        TOptional<FBinaryShard> Shard = PendingShards[0].Get();
+        PendingShards.RemoveAt(0);
+
+        if (Shard.IsSet())
+        {
+            Shards.Add(MoveTemp(Shard.GetValue()));
+        }
+        else
+        {
+            bFailed = true;
+        }
+    }
+}
+
+bool FBinaryFileWriter::Finish(TArray<FString>& OutFilePaths)
+{
+    if (bSharded && !bFailed && PendingRows.Num() > 0)
+    {
+        FlushShard();
+    }
+    CollectShards(0);
+
+    if (bFailed || bFinished)
+    {
+        return false;
+    }
+
+    // Dimensions are stored as int32
+    if (NumRows > MAX_int32)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s holds %lld rows, only %d fit into its dimensions"), *FilePath, NumRows, MAX_int32);
+        bFailed = true;
+        return false;
+    }
+
+    if (bSharded)
+    {
+        for (int32 ShardIndex = 0; ShardIndex < NumShards; ShardIndex++)
+        {
+            OutFilePaths.Add(GetShardPath(FilePath, ShardIndex));
+        }
+
+        bFailed = !WriteManifest();
+        OutFilePaths.Add(FilePath + TEXT(".manifest.json"));
+    }
+    else
+    {
+        int32 RowCount = static_cast<int32>(NumRows);
+        FileWriter->Seek(sizeof(int32));
+        *FileWriter << RowCount;
+        bFailed = !FileWriter->Close() || FileWriter->IsError();
+        FileWriter.Reset();
+        OutFilePaths.Add(FilePath);
+    }
+
+    if (bFailed)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write %s"), *FilePath);
+        return false;
+    }
+
+    bFinished = true;
+    return true;
+}
+
+bool FBinaryFileWriter::WriteManifest()
+{
+    TSharedRef<FJsonObject> ManifestObject = MakeShared<FJsonObject>();
+    ManifestObject->SetNumberField(TEXT("version"), 2);
+    ManifestObject->SetStringField(TEXT("encoding"), EncodingToString(Encoding));
+    ManifestObject->SetStringField(TEXT("compression"), CompressionToString(Compression));
+    ManifestObject->SetNumberField(TEXT("row_size"), RowSize);
+
+    TArray<TSharedPtr<FJsonValue>> DimensionValues;
+    DimensionValues.Add(MakeShared<FJsonValueNumber>(static_cast<double>(NumRows)));
+    for (int32 Dimension : RowDimensions)
+    {
+        DimensionValues.Add(MakeShared<FJsonValueNumber>(Dimension));
+    }
+    ManifestObject->SetArrayField(TEXT("dimensions"), DimensionValues);
+
+    TArray<TSharedPtr<FJsonValue>> ShardValues;
+    for (const FBinaryShard& Shard : Shards)
+    {
+        TSharedRef<FJsonObject> ShardObject = MakeShared<FJsonObject>();
+        ShardObject->SetStringField(TEXT("file"), Shard.FileName);
+        ShardObject->SetNumberField(TEXT("first_row"), Shard.FirstRow);
+        ShardObject->SetNumberField(TEXT("num_rows"), Shard.NumRows);
+        ShardObject->SetNumberField(TEXT("size"), static_cast<double>(Shard.Size));
+        ShardObject->SetNumberField(TEXT("raw_size"), static_cast<double>(Shard.RawSize));
+        if (Shard.Scale.Num() > 0)
+        {
+            ShardObject->SetArrayField(TEXT("scale"), MakeNumberValues(Shard.Scale));
+            ShardObject->SetArrayField(TEXT("offset"), MakeNumberValues(Shard.Offset));
+        }
+        ShardValues.Add(MakeShared<FJsonValueObject>(ShardObject));
+    }
+    ManifestObject->SetArrayField(TEXT("shards"), ShardValues);
+
+    FString ManifestString;
+    TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ManifestString);
+    FJsonSerializer::Serialize(ManifestObject, Writer);
+
+    const FString TempFilePath = UBinaryBuilder::GetAbsolutePath(FilePath + TEXT(".manifest.json") + TempSuffix);
+    TempFilePaths.Add(TempFilePath);
+    return FFileHelper::SaveStringToFile(ManifestString, *TempFilePath);
+}
+
+bool UBinaryBuilder::LoadShardManifest(const FString& ManifestPath, FBinaryShardManifest& OutManifest)
+{
+    FString ManifestString;
+    if (!FFileHelper::LoadFileToString(ManifestString, *ManifestPath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to read shard manifest %s"), *ManifestPath);
+        return false;
+    }
+
+    TSharedPtr<FJsonObject> ManifestObject;
+    TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(ManifestString);
+    if (!FJsonSerializer::Deserialize(Reader, ManifestObject) || !ManifestObject.IsValid())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to parse shard manifest %s"), *ManifestPath);
+        return false;
+    }
+
+    OutManifest = FBinaryShardManifest();
+    OutManifest.Directory = FPaths::GetPath(ManifestPath);
+    OutManifest.Encoding = EncodingFromString(ManifestObject->GetStringField(TEXT("encoding")));
+    OutManifest.Compression = CompressionFromString(ManifestObject->GetStringField(TEXT("compression")));
+    OutManifest.RowSize = static_cast<int32>(ManifestObject->GetNumberField(TEXT("row_size")));
+
+    for (const TSharedPtr<FJsonValue>& Value : ManifestObject->GetArrayField(TEXT("dimensions")))
+    {
+        OutManifest.Dimensions.Add(static_cast<int32>(Value->AsNumber()));
+    }
+    const TArray<TSharedPtr<FJsonValue>>* Values = nullptr;
+    if (ManifestObject->TryGetArrayField(TEXT("scale"), Values))
+    {
+        for (const TSharedPtr<FJsonValue>& Value : *Values)
+        {
+            OutManifest.Scale.Add(static_cast<float>(Value->AsNumber()));
+        }
+    }
+    if (ManifestObject->TryGetArrayField(TEXT("offset"), Values))
+    {
+        for (const TSharedPtr<FJsonValue>& Value : *Values)
+        {
+            OutManifest.Offset.Add(static_cast<float>(Value->AsNumber()));
+        }
+    }
+    for (const TSharedPtr<FJsonValue>& Value : ManifestObject->GetArrayField(TEXT("shards")))
+    {
+        const TSharedPtr<FJsonObject>& ShardObject = Value->AsObject();
+        FBinaryShard& Shard = OutManifest.Shards.AddDefaulted_GetRef();
+        Shard.FileName = ShardObject->GetStringField(TEXT("file"));
+        Shard.FirstRow = static_cast<int32>(ShardObject->GetNumberField(TEXT("first_row")));
+        Shard.NumRows = static_cast<int32>(ShardObject->GetNumberField(TEXT("num_rows")));
+        Shard.Size = static_cast<int64>(ShardObject->GetNumberField(TEXT("size")));
+        Shard.RawSize = static_cast<int64>(ShardObject->GetNumberField(TEXT("raw_size")));
+
+        if (ShardObject->TryGetArrayField(TEXT("scale"), Values))
+        {
+            for (const TSharedPtr<FJsonValue>& ScaleValue : *Values)
+            {
+                Shard.Scale.Add(static_cast<float>(ScaleValue->AsNumber()));
+            }
+        }
+        if (ShardObject->TryGetArrayField(TEXT("offset"), Values))
+        {
+            for (const TSharedPtr<FJsonValue>& OffsetValue : *Values)
+            {
+                Shard.Offset.Add(static_cast<float>(OffsetValue->AsNumber()));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool UBinaryBuilder::LoadShard(const FBinaryShardManifest& Manifest, int32 ShardIndex, TArray<float>& OutData)
+{
+    if (!Manifest.Shards.IsValidIndex(ShardIndex))
+    {
+        return false;
+    }
+
+    const FBinaryShard& Shard = Manifest.Shards[ShardIndex];
+    const FString ShardPath = FPaths::Combine(Manifest.Directory, Shard.FileName);
+
+    TArray<uint8> Payload;
+    if (!FFileHelper::LoadFileToArray(Payload, *ShardPath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to read shard %s"), *ShardPath);
+        return false;
+    }
+
+    if (Payload.Num() != Shard.Size)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Shard %s is %d bytes, the manifest expects %lld"), *ShardPath, Payload.Num(), Shard.Size);
+        return false;
+    }
+
+    const int64 Count = static_cast<int64>(Shard.NumRows) * Manifest.RowSize;
+    const int64 ExpectedRawSize = Count * GetEncodedElementSize(Manifest.Encoding);
+
+    // Manifests of version 1 store a single range for all shards
+    const TArray<float>& Scale = Shard.Scale.Num() > 0 ? Shard.Scale : Manifest.Scale;
+    const TArray<float>& Offset = Shard.Scale.Num() > 0 ? Shard.Offset : Manifest.Offset;
+
+    const bool bIsQuantized = Manifest.Encoding == EBinaryEncoding::Quantized16 || Manifest.Encoding == EBinaryEncoding::Quantized8;
+    if (bIsQuantized && (Scale.Num() != Manifest.RowSize || Offset.Num() != Manifest.RowSize))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Manifest of shard %s has %d scales and %d offsets for rows of %d values"), *ShardPath, Scale.Num(), Offset.Num(), Manifest.RowSize);
+        return false;
+    }
+
+    TArray<uint8> Raw;
+    const FName CompressionFormat = GetCompressionFormat(Manifest.Compression);
+    if (CompressionFormat.IsNone() || Shard.RawSize == 0)
+    {
+        Raw = MoveTemp(Payload);
+    }
+    else
+    {
+        // Checked before allocating, so a corrupt manifest cannot request an arbitrary buffer
+        if (Shard.RawSize != ExpectedRawSize)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Shard %s decompresses to %lld bytes, %lld values of %s need %lld"), *ShardPath, Shard.RawSize, Count, EncodingToString(Manifest.Encoding), ExpectedRawSize);
+            return false;
+        }
+
+        Raw.SetNumUninitialized(Shard.RawSize);
+        if (!FCompression::UncompressMemory(CompressionFormat, Raw.GetData(), Raw.Num(), Payload.GetData(), Payload.Num()))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to decompress shard %s"), *ShardPath);
+            return false;
+        }
+    }
+
+    if (Raw.Num() != ExpectedRawSize)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Shard %s holds %d bytes, %lld values of %s need %lld"), *ShardPath, Raw.Num(), Count, EncodingToString(Manifest.Encoding), ExpectedRawSize);
+        return false;
+    }
+
+    OutData.SetNumUninitialized(Count);
+
+    switch (Manifest.Encoding)
+    {
+        case EBinaryEncoding::Float16:
+        {
+            const uint16* Source = reinterpret_cast<const uint16*>(Raw.GetData());
+            for (int64 i = 0; i < Count; i++)
+            {
+                FFloat16 Value;
+                Value.Encoded = Source[i];
+                OutData[i] = Value.GetFloat();
+            }
+            break;
+        }
+        case EBinaryEncoding::Quantized16:
+            Dequantize<uint16>(Raw.GetData(), Count, Manifest.RowSize, Scale, Offset, OutData.GetData());
+            break;
+        case EBinaryEncoding::Quantized8:
+            Dequantize<uint8>(Raw.GetData(), Count, Manifest.RowSize, Scale, Offset, OutData.GetData());
+            break;
+        default:
+            FMemory::Memcpy(OutData.GetData(), Raw.GetData(), Count * sizeof(float));
+            break;
+    }
+
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "CrowdInference.h"
+#include "InferenceCache.h"
+#include "InferenceExecutor.h"
+#include "Misc/ScopeLock.h"
+#include "UObject/ObjectKey.h"
+
+namespace
+{
+        using FCrowdKey = TTuple<FObjectKey, uint32>;
+
+        FCriticalSection CrowdsCriticalSection;
+        TMap<FCrowdKey, TWeakPtr<FCrowdInference>> Crowds;
+}
+
+TSharedRef<FCrowdInference> FCrowdInference::Get(const UNNEModelData* ModelData, float InClusterSize)
+{
+        FScopeLock CrowdsLock(&CrowdsCriticalSection);
+
+        // Crowds whose nodes have all been destroyed are dropped on the way
+        for (auto It = Crowds.CreateIterator(); It; ++It)
+        {
+                if (!It->Value.IsValid())
+                {
+                        It.RemoveCurrent();
+                }
+        }
+
+        const FCrowdKey Key(FObjectKey(ModelData), GetTypeHash(InClusterSize));
+        if (TSharedPtr<FCrowdInference> Crowd = Crowds.FindRef(Key).Pin())
+        {
+                return Crowd.ToSharedRef();
+        }
+
+        TSharedRef<FCrowdInference> Crowd = MakeShared<FCrowdInference>(InClusterSize);
+        Crowds.Add(Key, Crowd);
+        return Crowd;
+}
+
+FCrowdInference::FCrowdInference(float InClusterSize)
+        : ClusterSize(FMath::Max(InClusterSize, 0.0f))
+{
+}
+
+uint64 FCrowdInference::ComputeClusterKey(TConstArrayView<TArrayView<float>> Inputs) const
+{
+        return FInferenceCache::HashInputs(Inputs, ClusterSize);
+}
+
+TSharedFuture<TArray<float>> FCrowdInference::Join(uint64 ClusterKey, const TSharedPtr<FModelInstance>& ModelInstance)
+{
+        TUniquePtr<TPromise<TArray<float>>> Promise;
+        TSharedFuture<TArray<float>> ClusterOutput;
+        {
+                FScopeLock ClustersLock(&ClustersCriticalSection);
+
+                // Clusters only live for one frame, the first node evaluated in a new frame starts over
+                if (ClusterFrame != GFrameCounter)
+                {
+                        LastFrameClusters = Clusters.Num();
+                        LastFrameMembers = FrameMembers;
+                        Clusters.Reset();
+                        FrameMembers = 0;
+                        ClusterFrame = GFrameCounter;
+                }
+
+                FrameMembers++;
+                if (const TSharedFuture<TArray<float>>* ExistingOutput = Clusters.Find(ClusterKey))
+                {
+                        return *ExistingOutput;
+                }
+
+                Promise = MakeUnique<TPromise<TArray<float>>>();
+                ClusterOutput = Promise->GetFuture().Share();
+                Clusters.Add(ClusterKey, ClusterOutput);
+        }
+
+        // Launched right away instead of run by the representative's node, so members evaluated first never wait on a node that has not started
+        FInferenceExecutor::Get().Submit([Promise = MoveTemp(Promise), ModelInstance]() mutable
+                {
+                        if (ModelInstance->RunModel() == 0)
+                        {
+                                Promise->SetValue(TArray<float>());
+                                return;
+                        }
+                        Promise->SetValue(TArray<float>(ModelInstance->GetOutputData(0)));
+                });
+        return ClusterOutput;
+}
+
+int32 FCrowdInference::NumClusters() const
+{
+        FScopeLock ClustersLock(&ClustersCriticalSection);
+        return LastFrameClusters;
+}
+
+int32 FCrowdInference::NumMembers() const
+{
+        FScopeLock ClustersLock(&ClustersCriticalSection);
+        return LastFrameMembers;
+}
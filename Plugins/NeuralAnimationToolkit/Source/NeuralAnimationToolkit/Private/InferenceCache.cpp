@@ -0,0 +1,114 @@
+#include "InferenceCache.h"
+#include "Hash/xxhash.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/ScopeRWLock.h"
+#include "UObject/ObjectKey.h"
+
+namespace
+{
+        using FSharedCacheKey = TTuple<FObjectKey, uint32>;
+
+        FCriticalSection SharedCachesCriticalSection;
+        TMap<FSharedCacheKey, TWeakPtr<FInferenceCache>> SharedCaches;
+}
+
+FInferenceCache::FInferenceCache(float InTolerance, int32 InCapacity)
+        : Tolerance(FMath::Max(InTolerance, 0.0f))
+        , Capacity(FMath::Max(InCapacity, 1))
+{
+        EntryIndices.Reserve(Capacity);
+}
+
+TSharedRef<FInferenceCache> FInferenceCache::GetShared(const UNNEModelData* ModelData, float InTolerance, int32 InCapacity)
+{
+        FScopeLock SharedCachesLock(&SharedCachesCriticalSection);
+
+        // Caches of destroyed nodes are dropped on the way
+        for (auto It = SharedCaches.CreateIterator(); It; ++It)
+        {
+                if (!It->Value.IsValid())
+                {
+                        It.RemoveCurrent();
+                }
+        }
+
+        const FSharedCacheKey Key(FObjectKey(ModelData), GetTypeHash(InTolerance));
+        if (TSharedPtr<FInferenceCache> Cache = SharedCaches.FindRef(Key).Pin())
+        {
+                return Cache.ToSharedRef();
+        }
+
+        TSharedRef<FInferenceCache> Cache = MakeShared<FInferenceCache>(InTolerance, InCapacity);
+        SharedCaches.Add(Key, Cache);
+        return Cache;
+}
+
+uint64 FInferenceCache::HashInputs(TConstArrayView<TArrayView<float>> Inputs, float InTolerance)
+{
+        const float InvTolerance = InTolerance > 0.0f ? 1.0f / InTolerance : 0.0f;
+
+        // Quantized in small blocks so nothing is allocated per call
+        constexpr int32 BlockSize = 256;
+        int32 Block[BlockSize];
+
+        FXxHash64Builder Builder;
+        for (const TArrayView<float>& Input : Inputs)
+        {
+                for (int32 Start = 0; Start < Input.Num(); Start += BlockSize)
+                {
+                        const int32 Count = FMath::Min(BlockSize, Input.Num() - Start);
+                        for (int32 i = 0; i < Count; i++)
+                        {
+                                const float Value = Input[Start + i];
+                                Block[i] = InvTolerance > 0.0f ? FMath::RoundToInt(Value * InvTolerance) : static_cast<int32>(BitCast<uint32>(Value));
+                        }
+                        Builder.Update(Block, Count * sizeof(int32));
+                }
+
+                // Separates the inputs so moving values between them changes the key
+                const int32 Num = Input.Num();
+                Builder.Update(&Num, sizeof(Num));
+        }
+        return Builder.Finalize().Hash;
+}
+
+bool FInferenceCache::Find(uint64 Key, TArray<float>& OutOutput)
+{
+        {
+                FReadScopeLock ReadLock(Lock);
+                if (const int32* Index = EntryIndices.Find(Key))
+                {
+                        OutOutput = EntryOutputs[*Index];
+                        Hits.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                }
+        }
+
+        Misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+}
+
+void FInferenceCache::Add(uint64 Key, TConstArrayView<float> Output)
+{
+        FWriteScopeLock WriteLock(Lock);
+        if (EntryIndices.Contains(Key))
+        {
+                return;
+        }
+
+        if (EntryOutputs.Num() < Capacity)
+        {
+                EntryIndices.Add(Key, EntryOutputs.Num());
+                EntryKeys.Add(Key);
+                EntryOutputs.Emplace(Output);
+                return;
+        }
+
+        // The oldest entry is replaced, its buffer is reused
+        EntryIndices.Remove(EntryKeys[NextEntry]);
+        EntryIndices.Add(Key, NextEntry);
+        EntryKeys[NextEntry] = Key;
+        EntryOutputs[NextEntry].Reset();
+        EntryOutputs[NextEntry].Append(Output.GetData(), Output.Num());
+        NextEntry = (NextEntry + 1) % Capacity;
+}
@@ -0,0 +1,265 @@
+#include "InferenceExecutor.h"
+#include "NeuralAnimationToolkitSettings.h"
+#include "HAL/Event.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+        // Only taken to create the pool, afterwards Get is a single load of the published pointer
+        FCriticalSection ExecutorCriticalSection;
+        TUniquePtr<FInferenceExecutor> ExecutorInstance;
+        std::atomic<FInferenceExecutor*> PublishedExecutor = nullptr;
+
+        FAutoConsoleCommand InferenceStatsCommand(
+                TEXT("NeuralAnimation.InferenceStats"),
+                TEXT("Logs the queue depth and wait times of the inference threads, pass reset to clear them"),
+                FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+                        {
+                                FInferenceExecutor& Executor = FInferenceExecutor::Get();
+                                UE_LOG(LogTemp, Display, TEXT("%s"), *Executor.GetStats().ToString());
+                                if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+                                {
+                                        Executor.ResetStats();
+                                }
+                        }));
+
+        template<typename T>
+        void UpdateMax(std::atomic<T>& Max, T Value)
+        {
+                T Current = Max.load(std::memory_order_relaxed);
+                while (Value > Current && !Max.compare_exchange_weak(Current, Value, std::memory_order_relaxed))
+                {
+                }
+        }
+}
+
+FString FInferenceExecutorStats::ToString() const
+{
+        return FString::Printf(TEXT("Inference threads: %d, queue depth %d (max %d), executed %llu (%llu stolen), wait %.3f ms (max %.3f ms)"),
+                NumThreads, QueueDepth, MaxQueueDepth, NumExecuted, NumStolen, AverageWaitTime * 1000.0, MaxWaitTime * 1000.0);
+}
+
+FInferenceExecutor::FWorker::FWorker(FInferenceExecutor& InExecutor, int32 InIndex)
+        : Executor(InExecutor)
+        , Index(InIndex)
+{
+        WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+FInferenceExecutor::FWorker::~FWorker()
+{
+        FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+}
+
+uint32 FInferenceExecutor::FWorker::Run()
+{
+        while (!bStopRequested)
+        {
+                if (!Executor.ExecuteNext(Index))
+                {
+                        // A job submitted after the queues were found empty triggers the event, so the wait returns right away
+                        bIsIdle = true;
+                        WakeEvent->Wait();
+                        bIsIdle = false;
+                }
+        }
+        return 0;
+}
+
+void FInferenceExecutor::FWorker::Stop()
+{
+        bStopRequested = true;
+        WakeEvent->Trigger();
+}
+
+FInferenceExecutor& FInferenceExecutor::Get()
+{
+        if (FInferenceExecutor* Executor = PublishedExecutor.load(std::memory_order_acquire))
+        {
+                return *Executor;
+        }
+
+        FScopeLock ExecutorLock(&ExecutorCriticalSection);
+        if (!ExecutorInstance.IsValid())
+        {
+                const UNeuralAnimationToolkitSettings* Settings = GetDefault<UNeuralAnimationToolkitSettings>();
+                const uint64 AffinityMask = Settings->InferenceThreadAffinityMask != 0 ? static_cast<uint64>(Settings->InferenceThreadAffinityMask) : FPlatformAffinity::GetNoAffinityMask();
+                ExecutorInstance = TUniquePtr<FInferenceExecutor>(new FInferenceExecutor(FMath::Max(Settings->NumInferenceThreads, 1), AffinityMask));
+                PublishedExecutor.store(ExecutorInstance.Get(), std::memory_order_release);
+        }
+        return *ExecutorInstance;
+}
+
+void FInferenceExecutor::Shutdown()
+{
+        // The pool is stopped but not destroyed, so references still held by callers stay valid and later jobs run inline
+        if (FInferenceExecutor* Executor = PublishedExecutor.load(std::memory_order_acquire))
+        {
+                Executor->Stop();
+        }
+}
+
+void FInferenceExecutor::Stop()
+{
+        if (bIsStopping.exchange(true))
+        {
+                return;
+        }
+
+        // Submitters check the flag after announcing themselves, so once none is in flight no job can be pushed anymore
+        while (NumSubmitting.load() != 0)
+        {
+                FPlatformProcess::Yield();
+        }
+
+        for (TUniquePtr<FWorker>& Worker : Workers)
+        {
+                Worker->Stop();
+        }
+
+        for (TUniquePtr<FWorker>& Worker : Workers)
+        {
+                if (Worker->Thread)
+                {
+                        Worker->Thread->WaitForCompletion();
+                        delete Worker->Thread;
+                        Worker->Thread = nullptr;
+                }
+        }
+
+        // Nobody is waiting forever on a job that was still queued
+        for (int32 i = 0; i < Workers.Num(); i++)
+        {
+                while (ExecuteNext(i))
+                {
+                }
+        }
+}
+
+FInferenceExecutor::FInferenceExecutor(int32 NumThreads, uint64 AffinityMask)
+{
+        for (int32 i = 0; i < NumThreads; i++)
+        {
+                FWorker& Worker = *Workers.Add_GetRef(MakeUnique<FWorker>(*this, i));
+                Worker.Thread = FRunnableThread::Create(&Worker, *FString::Printf(TEXT("NeuralAnimationInference%d"), i), 0, TPri_Normal, AffinityMask);
+        }
+}
+
+FInferenceExecutor::~FInferenceExecutor()
+{
+        Stop();
+}
+
+void FInferenceExecutor::Submit(TUniqueFunction<void()> Function)
+{
+        NumSubmitting.fetch_add(1);
+        if (bIsStopping.load())
+        {
+                NumSubmitting.fetch_sub(1);
+                Function();
+                return;
+        }
+
+        FJob* Job = new FJob();
+        Job->Function = MoveTemp(Function);
+        Job->SubmitCycles = FPlatformTime::Cycles64();
+
+        UpdateMax(MaxQueueDepth, QueueDepth.fetch_add(1, std::memory_order_relaxed) + 1);
+
+        const int32 TargetIndex = NextWorker.fetch_add(1, std::memory_order_relaxed) % Workers.Num();
+        Workers[TargetIndex]->Queue.Push(Job);
+
+        // Wake the owner of the queue, or an idle thread that will steal the job if the owner is busy
+        FWorker* WorkerToWake = Workers[TargetIndex].Get();
+        if (!WorkerToWake->bIsIdle)
+        {
+                for (const TUniquePtr<FWorker>& Worker : Workers)
+                {
+                        if (Worker->bIsIdle)
+                        {
+                                WorkerToWake = Worker.Get();
+                                break;
+                        }
+                }
+        }
+        WorkerToWake->WakeEvent->Trigger();
+        NumSubmitting.fetch_sub(1);
+}
+
+TFuture<int32> FInferenceExecutor::Launch(TUniqueFunction<int32()> Function)
+{
+        TPromise<int32> Promise;
+        TFuture<int32> Future = Promise.GetFuture();
+
+        Submit([Promise = MoveTemp(Promise), Function = MoveTemp(Function)]() mutable
+                {
+                        Promise.SetValue(Function());
+                });
+
+        return Future;
+}
+
+bool FInferenceExecutor::ExecuteNext(int32 WorkerIndex)
+{
+        if (FJob* Job = Workers[WorkerIndex]->Queue.Pop())
+        {
+                Execute(Job, false);
+                return true;
+        }
+
+        for (int32 Offset = 1; Offset < Workers.Num(); Offset++)
+        {
+                if (FJob* Job = Workers[(WorkerIndex + Offset) % Workers.Num()]->Queue.Pop())
+                {
+                        Execute(Job, true);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+void FInferenceExecutor::Execute(FJob* Job, bool bStolen)
+{
+        const uint64 WaitCycles = FPlatformTime::Cycles64() - Job->SubmitCycles;
+        QueueDepth.fetch_sub(1, std::memory_order_relaxed);
+        TotalWaitCycles.fetch_add(WaitCycles, std::memory_order_relaxed);
+        UpdateMax(MaxWaitCycles, WaitCycles);
+        if (bStolen)
+        {
+                NumStolen.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Job->Function();
+        delete Job;
+
+        NumExecuted.fetch_add(1, std::memory_order_relaxed);
+}
+
+FInferenceExecutorStats FInferenceExecutor::GetStats() const
+{
+        FInferenceExecutorStats Stats;
+        Stats.NumThreads = Workers.Num();
+        Stats.QueueDepth = QueueDepth.load(std::memory_order_relaxed);
+        Stats.MaxQueueDepth = MaxQueueDepth.load(std::memory_order_relaxed);
+        Stats.NumExecuted = NumExecuted.load(std::memory_order_relaxed);
+        Stats.NumStolen = NumStolen.load(std::memory_order_relaxed);
+
+        const uint64 TotalWait = TotalWaitCycles.load(std::memory_order_relaxed);
+        Stats.AverageWaitTime = Stats.NumExecuted > 0 ? FPlatformTime::ToSeconds64(TotalWait) / Stats.NumExecuted : 0.0;
+        Stats.MaxWaitTime = FPlatformTime::ToSeconds64(MaxWaitCycles.load(std::memory_order_relaxed));
+        return Stats;
+}
+
+void FInferenceExecutor::ResetStats()
+{
+        MaxQueueDepth = QueueDepth.load();
+        NumExecuted = 0;
+        NumStolen = 0;
+        TotalWaitCycles = 0;
+        MaxWaitCycles = 0;
+}
@@ -1,97 +1,174 @@
 #include "ModelInstance.h"
 
-FModelInstance::FModelInstance(const TObjectPtr<UNNEModelData> ModelData, const TWeakInterfacePtr<INNERuntimeCPU> Runtime) {
-        TUniquePtr<UE::NNE::IModelCPU> Model = Runtime->CreateModel(ModelData);
-        if (Model.IsValid()) {
-                ModelInstance = Model->CreateModelInstance();
-                if (ModelInstance.IsValid()) {
-                        TConstArrayView<UE::NNE::FTensorDesc> InputTensorDescs = ModelInstance->GetInputTensorDescs();
-                        UE::NNE::FSymbolicTensorShape SymbolicInputTensorShape = InputTensorDescs[0].GetShape();
-                        InputTensorShapes = { UE::NNE::FTensorShape::MakeFromSymbolic(SymbolicInputTensorShape) };
-
-                        ModelInstance->SetInputTensorShapes(InputTensorShapes);
-
-                        TConstArrayView<UE::NNE::FTensorDesc> OutputTensorDescs = ModelInstance->GetOutputTensorDescs();
-                        UE::NNE::FSymbolicTensorShape SymbolicOutputTensorShape = OutputTensorDescs[0].GetShape();
-                        OutputTensorShapes = { UE::NNE::FTensorShape::MakeFromSymbolic(SymbolicOutputTensorShape) };
-
-                        // Example for creating in- and outputs
-                        InputData.SetNumZeroed(InputTensorShapes[0].Volume());
-                        InputBindings.SetNumZeroed(1);
-                        InputBindings[0].Data = InputData.GetData();
-                        InputBindings[0].SizeInBytes = InputData.Num() * sizeof(float);
-
-                        OutputData.SetNumZeroed(OutputTensorShapes[0].Volume());
-                        OutputBindings.SetNumZeroed(1);
-                        OutputBindings[0].Data = OutputData.GetData();
-                        OutputBindings[0].SizeInBytes = OutputData.Num() * sizeof(float);
-
-                        UE_LOG(LogTemp, Warning, TEXT("Created Model with %d inputs and %d outputs"), InputTensorShapes[0].Volume(), OutputTensorShapes[0].Volume());
+namespace
+{
+        // Variable dimensions, usually the batch, are bound with a size of 1
+        UE::NNE::FTensorShape MakeConcreteShape(const UE::NNE::FSymbolicTensorShape& SymbolicShape)
+        {
+                if (SymbolicShape.IsConcrete())
+                {
+                        return UE::NNE::FTensorShape::MakeFromSymbolic(SymbolicShape);
+                }
+
+                TArray<uint32> Dimensions;
+                for (const int32 Dimension : SymbolicShape.GetData())
+                {
+                        Dimensions.Add(Dimension < 0 ? 1 : Dimension);
+                }
+                return UE::NNE::FTensorShape::Make(Dimensions);
+        }
+
+        // Uses the resolved shapes if the runtime knows them, otherwise the shapes of the model description
+        void BindTensors(TConstArrayView<UE::NNE::FTensorDesc> TensorDescs, TConstArrayView<UE::NNE::FTensorShape> ResolvedShapes, TArray<FModelTensor>& OutTensors, TArray<UE::NNE::FTensorShape>& OutShapes, TArray<UE::NNE::FTensorBindingCPU>& OutBindings)
+        {
+                OutTensors.SetNum(TensorDescs.Num());
+                OutShapes.Reset(TensorDescs.Num());
+                OutBindings.SetNumZeroed(TensorDescs.Num());
+
+                for (int32 i = 0; i < TensorDescs.Num(); i++)
+                {
+                        if (TensorDescs[i].GetDataType() != ENNETensorDataType::Float)
+                        {
+                                UE_LOG(LogTemp, Warning, TEXT("ModelInstance: Tensor %s is not a float tensor"), *TensorDescs[i].GetName());
+                        }
+
+                        const UE::NNE::FTensorShape& Shape = OutShapes.Add_GetRef(ResolvedShapes.Num() == TensorDescs.Num() ? ResolvedShapes[i] : MakeConcreteShape(TensorDescs[i].GetShape()));
+
+                        FModelTensor& Tensor = OutTensors[i];
+                        Tensor.Name = TensorDescs[i].GetName();
+                        Tensor.Shape.Reset();
+                        for (const uint32 Dimension : Shape.GetData())
+                        {
+                                Tensor.Shape.Add(Dimension);
+                        }
+                        Tensor.Data.SetNumZeroed(Shape.Volume());
+
+                        // The buffers are never resized again, so the bindings stay valid for the lifetime of the instance
+                        OutBindings[i].Data = Tensor.Data.GetData();
+                        OutBindings[i].SizeInBytes = Tensor.Data.Num() * sizeof(float);
                 }
         }
 }
 
-void FModelInstance::SetInputData(TArray<float> Data) {
-        if (InputData.Num() != InputTensorShapes[0].Volume()) {
-                UE_LOG(LogTemp, Error, TEXT("Input data size does not match model input size (%d != %d)"), InputData.Num(), InputTensorShapes[0].Volume());
+FModelInstance::FModelInstance(const TObjectPtr<UNNEModelData> ModelData, const TWeakInterfacePtr<INNERuntimeCPU> Runtime) {
+        Initialize(ModelData, Runtime);
+}
+
+FModelInstance::FModelInstance(UE::NNE::IModelCPU& Model) {
+        Initialize(Model);
+}
+
+void FModelInstance::SetInputData(const TArray<float>& Data) {
+        if (Inputs.Num() == 0 || Data.Num() != Inputs[0].Data.Num()) {
+                UE_LOG(LogTemp, Error, TEXT("Input data size does not match model input size (%d != %d)"), Data.Num(), Inputs.Num() > 0 ? Inputs[0].Data.Num() : 0);
                 return;
         }
 
-        InputData = Data;
-        InputBindings[0].Data = InputData.GetData();
-        InputBindings[0].SizeInBytes = InputData.Num() * sizeof(float);
+        FMemory::Memcpy(Inputs[0].Data.GetData(), Data.GetData(), Data.Num() * sizeof(float));
 }
 
 void FModelInstance::ClearOutputData() {
-        OutputData.Empty();
-        OutputData.SetNumZeroed(OutputTensorShapes[0].Volume());
-        OutputBindings[0].Data = OutputData.GetData();
-        OutputBindings[0].SizeInBytes = OutputData.Num() * sizeof(float);
+        for (FModelTensor& Output : Outputs) {
+                FMemory::Memzero(Output.Data.GetData(), Output.Data.Num() * sizeof(float));
+        }
 }
 
 void FModelInstance::Initialize(const TObjectPtr<UNNEModelData> ModelData, const TWeakInterfacePtr<INNERuntimeCPU> Runtime){
         TUniquePtr<UE::NNE::IModelCPU> Model = Runtime->CreateModel(ModelData);
         if (Model.IsValid()) {
-                ModelInstance = Model->CreateModelInstance();
-                if (ModelInstance.IsValid()) {
-                        TConstArrayView<UE::NNE::FTensorDesc> InputTensorDescs = ModelInstance->GetInputTensorDescs();
-                        UE::NNE::FSymbolicTensorShape SymbolicInputTensorShape = InputTensorDescs[0].GetShape();
-                        InputTensorShapes = { UE::NNE::FTensorShape::MakeFromSymbolic(SymbolicInputTensorShape) };
-
-                        ModelInstance->SetInputTensorShapes(InputTensorShapes);
-
-                        TConstArrayView<UE::NNE::FTensorDesc> OutputTensorDescs = ModelInstance->GetOutputTensorDescs();
-                        UE::NNE::FSymbolicTensorShape SymbolicOutputTensorShape = OutputTensorDescs[0].GetShape();
-                        OutputTensorShapes = { UE::NNE::FTensorShape::MakeFromSymbolic(SymbolicOutputTensorShape) };
-
-                        // Example for creating in- and outputs
-                        InputData.SetNumZeroed(InputTensorShapes[0].Volume());
-                        InputBindings.SetNumZeroed(1);
-                        InputBindings[0].Data = InputData.GetData();
-                        InputBindings[0].SizeInBytes = InputData.Num() * sizeof(float);
-
-                        OutputData.SetNumZeroed(OutputTensorShapes[0].Volume());
-                        OutputBindings.SetNumZeroed(1);
-                        OutputBindings[0].Data = OutputData.GetData();
-                        OutputBindings[0].SizeInBytes = OutputData.Num() * sizeof(float);
-
-                        UE_LOG(LogTemp, Warning, TEXT("Created Model with %d inputs and %d outputs"), InputTensorShapes[0].Volume(), OutputTensorShapes[0].Volume());
+                Initialize(*Model);
+        }
+}
+
+void FModelInstance::Initialize(UE::NNE::IModelCPU& Model) {
+        Initialize(Model.CreateModelInstance());
+}
+
+void FModelInstance::Initialize(TUniquePtr<UE::NNE::IModelInstanceCPU> InModelInstance) {
+        ModelInstance = MoveTemp(InModelInstance);
+        if (ModelInstance.IsValid()) {
+                BindTensors(ModelInstance->GetInputTensorDescs(), TConstArrayView<UE::NNE::FTensorShape>(), Inputs, InputTensorShapes, InputBindings);
+                ModelInstance->SetInputTensorShapes(InputTensorShapes);
+
+                // Output shapes with variable dimensions are only known after the input shapes have been set
+                BindTensors(ModelInstance->GetOutputTensorDescs(), ModelInstance->GetOutputTensorShapes(), Outputs, OutputTensorShapes, OutputBindings);
+
+                UE_LOG(LogTemp, Display, TEXT("Created Model with %d input and %d output tensors"), Inputs.Num(), Outputs.Num());
+        }
+}
+
+bool FModelInstance::IsValid() const {
+        return ModelInstance.IsValid();
+}
+
+bool FModelInstance::BindStates(TConstArrayView<FModelStateTensor> StateTensors) {
+        // Point every binding back at its own buffer before the states are bound again
+        for (const FStateBinding& State : States) {
+                InputBindings[State.Input].Data = Inputs[State.Input].Data.GetData();
+                OutputBindings[State.Output].Data = Outputs[State.Output].Data.GetData();
+        }
+        States.Reset();
+
+        bool bAllBound = true;
+        for (const FModelStateTensor& StateTensor : StateTensors) {
+                FStateBinding State;
+                State.Input = FindInput(StateTensor.Input);
+                State.Output = FindOutput(StateTensor.Output);
+
+                if (State.Input == INDEX_NONE || State.Output == INDEX_NONE) {
+                        UE_LOG(LogTemp, Warning, TEXT("ModelInstance: State %s -> %s does not exist in the model"), *StateTensor.Output, *StateTensor.Input);
+                        bAllBound = false;
+                        continue;
+                }
+
+                if (Inputs[State.Input].Data.Num() != Outputs[State.Output].Data.Num()) {
+                        UE_LOG(LogTemp, Warning, TEXT("ModelInstance: State %s -> %s differs in size (%d != %d)"), *StateTensor.Output, *StateTensor.Input, Outputs[State.Output].Data.Num(), Inputs[State.Input].Data.Num());
+                        bAllBound = false;
+                        continue;
                 }
+
+                States.Add(State);
         }
+
+        ResetStates();
+        return bAllBound;
 }
 
-int FModelInstance::RunModel(TArray<float> _InputData) {
-        SetInputData(_InputData);
-        ClearOutputData();
+void FModelInstance::ResetStates() {
+        for (const FStateBinding& State : States) {
+                FMemory::Memzero(Inputs[State.Input].Data.GetData(), Inputs[State.Input].Data.Num() * sizeof(float));
+                FMemory::Memzero(Outputs[State.Output].Data.GetData(), Outputs[State.Output].Data.Num() * sizeof(float));
+        }
+}
+
+TConstArrayView<float> FModelInstance::GetStateData(int32 Index) const {
+        if (!States.IsValidIndex(Index)) {
+                return TConstArrayView<float>();
+        }
+
+        const FStateBinding& State = States[Index];
+        return TConstArrayView<float>(static_cast<const float*>(InputBindings[State.Input].Data), Inputs[State.Input].Data.Num());
+}
 
+int FModelInstance::RunModel() {
         if (ModelInstance->RunSync(InputBindings, OutputBindings) != 0) {
                 UE_LOG(LogTemp, Error, TEXT("ModelInstance: Failed to run the model"));
                 return 0;
         }
 
+        // The buffer just written becomes the input of the next run and the old input is overwritten next time
+        for (const FStateBinding& State : States) {
+                Swap(InputBindings[State.Input].Data, OutputBindings[State.Output].Data);
+        }
+
         return 1;
 }
 
+int FModelInstance::RunModel(const TArray<float>& _InputData) {
+        SetInputData(_InputData);
+        return RunModel();
+}
+
 bool FModelInstance::CreateTensor(TArray<int32> Shape, UPARAM(ref) FNeuralNetworkTensor& Tensor) {
         if (Shape.Num() == 0) {
                 return false;
@@ -111,11 +188,38 @@ bool FModelInstance::CreateTensor(TArray<int32> Shape, UPARAM(ref) FNeuralNetwor
 }
 
 int32 FModelInstance::NumInputs() const {
-        return InputTensorShapes[0].Rank();
+        return Inputs.Num();
 }
 
 int32 FModelInstance::NumOutputs() const {
-        return OutputTensorShapes[0].Rank();
+        return Outputs.Num();
+}
+
+int32 FModelInstance::FindInput(const FString& Name) const {
+        return Inputs.IndexOfByPredicate([&Name](const FModelTensor& Tensor) { return Tensor.Name == Name; });
+}
+
+int32 FModelInstance::FindOutput(const FString& Name) const {
+        return Outputs.IndexOfByPredicate([&Name](const FModelTensor& Tensor) { return Tensor.Name == Name; });
+}
+
+TArrayView<float> FModelInstance::GetInputData(int32 Index) {
+        return Inputs.IsValidIndex(Index) ? TArrayView<float>(Inputs[Index].Data) : TArrayView<float>();
+}
+
+TConstArrayView<float> FModelInstance::GetOutputData(int32 Index) const {
+        if (!Outputs.IsValidIndex(Index)) {
+                return TConstArrayView<float>();
+        }
+
+        // A state output was swapped into the input binding after the run, that buffer holds what the last run wrote
+        for (const FStateBinding& State : States) {
+                if (State.Output == Index) {
+                        return TConstArrayView<float>(static_cast<const float*>(InputBindings[State.Input].Data), Outputs[Index].Data.Num());
+                }
+        }
+
+        return TConstArrayView<float>(Outputs[Index].Data);
 }
 
 TArray<int32> FModelInstance::GetInputShape(int32 Index) const {
@@ -0,0 +1,497 @@
+#include "ModelRegistry.h"
+#include "NeuralAnimationToolkitSettings.h"
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "Hash/xxhash.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/GarbageCollection.h"
+
+namespace
+{
+        FString GetAutotuneCachePath()
+        {
+                return FPaths::ProjectSavedDir() / TEXT("NeuralAnimationToolkit") / TEXT("RuntimeAutotune.json");
+        }
+
+        TSharedPtr<FJsonObject> LoadAutotuneCache()
+        {
+                FString CacheString;
+                TSharedPtr<FJsonObject> CacheObject;
+                if (FFileHelper::LoadFileToString(CacheString, *GetAutotuneCachePath()))
+                {
+                        TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(CacheString);
+                        FJsonSerializer::Deserialize(Reader, CacheObject);
+                }
+                return CacheObject.IsValid() ? CacheObject : MakeShared<FJsonObject>();
+        }
+
+        void SaveAutotuneCache(const TSharedRef<FJsonObject>& CacheObject)
+        {
+                FString CacheString;
+                TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&CacheString);
+                FJsonSerializer::Serialize(CacheObject, Writer);
+
+                if (!FFileHelper::SaveStringToFile(CacheString, *GetAutotuneCachePath()))
+                {
+                        UE_LOG(LogTemp, Warning, TEXT("ModelRegistry: Failed to write %s"), *GetAutotuneCachePath());
+                }
+        }
+}
+
+FModelRegistry& FModelRegistry::Get()
+{
+        static FModelRegistry Registry;
+        return Registry;
+}
+
+TSharedPtr<FModelRegistry::FModelEntry> FModelRegistry::FindEntry(const UNNEModelData* ModelData, const FString& RuntimeName) const
+{
+        FScopeLock Lock(&EntriesCriticalSection);
+        const FModelKey* Key = ModelKeys.Find(FAssetKey(FObjectKey(ModelData), RuntimeName));
+        if (Key == nullptr)
+        {
+                return nullptr;
+        }
+
+        const TSharedRef<FModelEntry>* Entry = Entries.Find(*Key);
+        return Entry ? TSharedPtr<FModelEntry>(*Entry) : nullptr;
+}
+
+TSharedPtr<FModelRegistry::FModelEntry> FModelRegistry::ResolveEntry(const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName)
+{
+        if (TSharedPtr<FModelEntry> Entry = FindEntry(WeakModelData.Get(), RuntimeName))
+        {
+                return Entry;
+        }
+
+        // Only one thread reads the model data at a time, the others find the entry it added once they get the lock
+        FScopeLock ResolveLock(&ResolveCriticalSection);
+        if (TSharedPtr<FModelEntry> Entry = FindEntry(WeakModelData.Get(), RuntimeName))
+        {
+                return Entry;
+        }
+
+        uint32 StartChangeCount = 0;
+        {
+                FScopeLock Lock(&EntriesCriticalSection);
+                StartChangeCount = ChangeCount;
+        }
+
+        uint64 Hash = 0;
+        FAssetKey AssetKey;
+        {
+                // The model data is read on this thread, garbage collection has to wait until it is done
+                FGCScopeGuard GCGuard;
+                UNNEModelData* ModelData = WeakModelData.Get();
+                if (ModelData == nullptr)
+                {
+                        return nullptr;
+                }
+
+                TConstArrayView<uint8> Data = ModelData->GetModelData(RuntimeName);
+                if (Data.Num() == 0)
+                {
+                        UE_LOG(LogTemp, Error, TEXT("ModelRegistry: Model %s has no data for runtime %s"), *ModelData->GetName(), *RuntimeName);
+                        return nullptr;
+                }
+
+                Hash = FXxHash64::HashBuffer(Data.GetData(), Data.Num()).Hash;
+                AssetKey = FAssetKey(FObjectKey(ModelData), RuntimeName);
+        }
+
+        const FModelKey Key(Hash, RuntimeName);
+
+        FScopeLock Lock(&EntriesCriticalSection);
+
+        // An asset changed while its data was hashed, the hash may be of the old data so it is not remembered
+        if (ChangeCount == StartChangeCount)
+        {
+                ModelKeys.Add(AssetKey, Key);
+        }
+        if (TSharedRef<FModelEntry>* Entry = Entries.Find(Key))
+        {
+                return *Entry;
+        }
+        return Entries.Add(Key, MakeShared<FModelEntry>());
+}
+
+TSharedPtr<UE::NNE::IModelCPU> FModelRegistry::GetOrCreateModel(FModelEntry& Entry, const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName)
+{
+        FScopeLock Lock(&Entry.CreateCriticalSection);
+        if (Entry.Model.IsValid() || Entry.bCreateFailed)
+        {
+                return Entry.Model;
+        }
+
+        TWeakInterfacePtr<INNERuntimeCPU> Runtime = UE::NNE::GetRuntime<INNERuntimeCPU>(RuntimeName);
+        if (!Runtime.IsValid())
+        {
+                UE_LOG(LogTemp, Error, TEXT("ModelRegistry: Runtime %s is not available"), *RuntimeName);
+                Entry.bCreateFailed = true;
+                return nullptr;
+        }
+
+        FGCScopeGuard GCGuard;
+        UNNEModelData* ModelData = WeakModelData.Get();
+        if (ModelData == nullptr)
+        {
+                return nullptr;
+        }
+
+        TUniquePtr<UE::NNE::IModelCPU> Model = Runtime->CreateModel(ModelData);
+        if (!Model.IsValid())
+        {
+                UE_LOG(LogTemp, Error, TEXT("ModelRegistry: Failed to create model %s with runtime %s"), *ModelData->GetName(), *RuntimeName);
+                Entry.bCreateFailed = true;
+                return nullptr;
+        }
+
+        Entry.Model = TSharedPtr<UE::NNE::IModelCPU>(Model.Release());
+        return Entry.Model;
+}
+
+TSharedPtr<FModelInstance> FModelRegistry::WrapInstance(const TSharedRef<FModelEntry>& Entry, TUniquePtr<UE::NNE::IModelInstanceCPU> Instance)
+{
+        // Once the last reference is gone the NNE instance goes back to the entry instead of being destroyed
+        TWeakPtr<FModelEntry> WeakEntry = Entry;
+        TSharedPtr<FModelInstance> ModelInstance = MakeShareable(new FModelInstance(), [this, WeakEntry](FModelInstance* Released)
+                {
+                        RecycleInstance(WeakEntry, Released);
+                });
+
+        ModelInstance->Initialize(MoveTemp(Instance));
+        return ModelInstance;
+}
+
+void FModelRegistry::RecycleInstance(const TWeakPtr<FModelEntry>& WeakEntry, FModelInstance* Instance)
+{
+        // The entry is gone once the model has been released, its instances are destroyed with the last node using them
+        if (TSharedPtr<FModelEntry> Entry = WeakEntry.Pin())
+        {
+                if (Instance->ModelInstance.IsValid())
+                {
+                        FScopeLock Lock(&EntriesCriticalSection);
+                        Entry->FreeInstances.Add(MoveTemp(Instance->ModelInstance));
+                }
+        }
+        delete Instance;
+}
+
+TSharedPtr<FModelInstance> FModelRegistry::CreateInstance(const TSharedRef<FModelEntry>& Entry, const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName)
+{
+        {
+                FScopeLock Lock(&EntriesCriticalSection);
+                if (Entry->FreeInstances.Num() > 0)
+                {
+                        TUniquePtr<UE::NNE::IModelInstanceCPU> Instance = Entry->FreeInstances.Pop(false);
+                        return WrapInstance(Entry, MoveTemp(Instance));
+                }
+        }
+
+        TSharedPtr<UE::NNE::IModelCPU> Model = GetOrCreateModel(*Entry, WeakModelData, RuntimeName);
+        if (!Model.IsValid())
+        {
+                return nullptr;
+        }
+
+        TUniquePtr<UE::NNE::IModelInstanceCPU> Instance = Model->CreateModelInstance();
+        if (!Instance.IsValid())
+        {
+                UE_LOG(LogTemp, Error, TEXT("ModelRegistry: Failed to create model instance with runtime %s"), *RuntimeName);
+                return nullptr;
+        }
+        return WrapInstance(Entry, MoveTemp(Instance));
+}
+
+TFuture<TSharedPtr<FModelInstance>> FModelRegistry::RequestInstance(UNNEModelData* ModelData, const FString& RuntimeName)
+{
+        if (ModelData == nullptr)
+        {
+                return MakeFulfilledPromise<TSharedPtr<FModelInstance>>(nullptr).GetFuture();
+        }
+
+        // Preloaded and recycled instances are handed out right away
+        const FString KnownRuntimeName = RuntimeName.IsEmpty() ? FindSelectedRuntime(ModelData) : RuntimeName;
+        TSharedPtr<FModelEntry> Entry = KnownRuntimeName.IsEmpty() ? nullptr : FindEntry(ModelData, KnownRuntimeName);
+        if (Entry.IsValid())
+        {
+                TSharedPtr<FModelInstance> Instance;
+                TUniquePtr<UE::NNE::IModelInstanceCPU> FreeInstance;
+                {
+                        FScopeLock Lock(&EntriesCriticalSection);
+                        if (Entry->PreloadedInstances.Num() > 0)
+                        {
+                                Instance = Entry->PreloadedInstances.Pop(false);
+                        }
+                        else if (Entry->FreeInstances.Num() > 0)
+                        {
+                                FreeInstance = Entry->FreeInstances.Pop(false);
+                        }
+                }
+
+                if (FreeInstance.IsValid())
+                {
+                        Instance = WrapInstance(Entry.ToSharedRef(), MoveTemp(FreeInstance));
+                }
+
+                if (Instance.IsValid())
+                {
+                        return MakeFulfilledPromise<TSharedPtr<FModelInstance>>(Instance).GetFuture();
+                }
+        }
+
+        // Creating the ORT session can take hundreds of milliseconds, so it runs on the thread pool rather than the task graph the animation uses
+        TWeakObjectPtr<UNNEModelData> WeakModelData = ModelData;
+        return Async(EAsyncExecution::ThreadPool, [this, WeakModelData, RuntimeName]() -> TSharedPtr<FModelInstance>
+                {
+                        const FString SelectedRuntimeName = RuntimeName.IsEmpty() ? SelectRuntime(WeakModelData) : RuntimeName;
+                        TSharedPtr<FModelEntry> Entry = ResolveEntry(WeakModelData, SelectedRuntimeName);
+                        return Entry.IsValid() ? CreateInstance(Entry.ToSharedRef(), WeakModelData, SelectedRuntimeName) : nullptr;
+                });
+}
+
+void FModelRegistry::Preload(UNNEModelData* ModelData, int32 NumInstances, const FString& RuntimeName)
+{
+        if (ModelData == nullptr || NumInstances < 1)
+        {
+                return;
+        }
+
+        TWeakObjectPtr<UNNEModelData> WeakModelData = ModelData;
+
+        // The model is resolved and created once before the instances are created in parallel
+        Async(EAsyncExecution::ThreadPool, [this, WeakModelData, NumInstances, RuntimeName]()
+                {
+                        const FString SelectedRuntimeName = RuntimeName.IsEmpty() ? SelectRuntime(WeakModelData) : RuntimeName;
+                        TSharedPtr<FModelEntry> Entry = ResolveEntry(WeakModelData, SelectedRuntimeName);
+                        if (!Entry.IsValid() || !GetOrCreateModel(*Entry, WeakModelData, SelectedRuntimeName).IsValid())
+                        {
+                                return;
+                        }
+
+                        const TSharedRef<FModelEntry> EntryRef = Entry.ToSharedRef();
+                        auto PreloadInstance = [this, EntryRef, WeakModelData, SelectedRuntimeName]()
+                        {
+                                TSharedPtr<FModelInstance> Instance = CreateInstance(EntryRef, WeakModelData, SelectedRuntimeName);
+                                if (Instance.IsValid())
+                                {
+                                        FScopeLock Lock(&EntriesCriticalSection);
+                                        EntryRef->PreloadedInstances.Add(Instance);
+                                }
+                        };
+
+                        for (int32 i = 1; i < NumInstances; i++)
+                        {
+                                Async(EAsyncExecution::ThreadPool, PreloadInstance);
+                        }
+                        PreloadInstance();
+                });
+}
+
+void FModelRegistry::Release(const UNNEModelData* ModelData)
+{
+        ReleaseRuntime(FObjectKey(ModelData), FString());
+}
+
+void FModelRegistry::Invalidate(const UNNEModelData* ModelData)
+{
+        const FObjectKey ObjectKey(ModelData);
+        {
+                FScopeLock Lock(&EntriesCriticalSection);
+                ChangeCount++;
+                SelectedRuntimes.Remove(ObjectKey);
+        }
+
+        // Instances of the old model still in use stay valid, only new requests get the new one
+        ReleaseRuntime(ObjectKey, FString());
+}
+
+void FModelRegistry::ReleaseRuntime(const FObjectKey& ObjectKey, const FString& RuntimeName)
+{
+        // Instances are destroyed outside of the lock, their deleters take it again
+        TArray<TSharedRef<FModelEntry>> ReleasedEntries;
+        {
+                FScopeLock Lock(&EntriesCriticalSection);
+                for (auto It = ModelKeys.CreateIterator(); It; ++It)
+                {
+                        if (It.Key().Get<0>() == ObjectKey && (RuntimeName.IsEmpty() || It.Key().Get<1>() == RuntimeName))
+                        {
+                                if (const TSharedRef<FModelEntry>* Entry = Entries.Find(It.Value()))
+                                {
+                                        ReleasedEntries.Add(*Entry);
+                                        Entries.Remove(It.Value());
+                                }
+                                It.RemoveCurrent();
+                        }
+                }
+        }
+}
+
+FString FModelRegistry::FindSelectedRuntime(const UNNEModelData* ModelData) const
+{
+        const UNeuralAnimationToolkitSettings* Settings = GetDefault<UNeuralAnimationToolkitSettings>();
+        if (!Settings->RuntimeOverride.IsEmpty())
+        {
+                return Settings->RuntimeOverride;
+        }
+
+        if (!Settings->bAutotuneRuntime)
+        {
+                return UNeuralAnimationToolkitSettings::DefaultRuntimeName;
+        }
+
+        FScopeLock Lock(&EntriesCriticalSection);
+        const FString* RuntimeName = SelectedRuntimes.Find(FObjectKey(ModelData));
+        return RuntimeName ? *RuntimeName : FString();
+}
+
+FString FModelRegistry::SelectRuntime(const TWeakObjectPtr<UNNEModelData>& WeakModelData)
+{
+        const FString KnownRuntimeName = FindSelectedRuntime(WeakModelData.Get());
+        if (!KnownRuntimeName.IsEmpty())
+        {
+                return KnownRuntimeName;
+        }
+
+        FScopeLock SelectionLock(&SelectionCriticalSection);
+
+        // Another thread may have finished the benchmark while this one was waiting
+        const FString WaitedRuntimeName = FindSelectedRuntime(WeakModelData.Get());
+        if (!WaitedRuntimeName.IsEmpty())
+        {
+                return WaitedRuntimeName;
+        }
+
+        // The choice depends on the model and on the CPU it runs on
+        FString CacheKey;
+        FObjectKey ObjectKey;
+        {
+                FGCScopeGuard GCGuard;
+                UNNEModelData* ModelData = WeakModelData.Get();
+                if (ModelData == nullptr)
+                {
+                        return FString();
+                }
+
+                TConstArrayView<uint8> Data = ModelData->GetModelData(UNeuralAnimationToolkitSettings::DefaultRuntimeName);
+                const uint64 Hash = FXxHash64::HashBuffer(Data.GetData(), Data.Num()).Hash;
+                CacheKey = FString::Printf(TEXT("%s|%016llx|%s"), *ModelData->GetPathName(), Hash, *FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+                ObjectKey = FObjectKey(ModelData);
+        }
+
+        if (!AutotuneCache.IsValid())
+        {
+                AutotuneCache = LoadAutotuneCache();
+        }
+
+        const TArray<FString> RuntimeNames = UE::NNE::GetAllRuntimeNames<INNERuntimeCPU>();
+
+        FString SelectedRuntimeName;
+        FString CachedRuntimeName;
+        if (AutotuneCache->TryGetStringField(CacheKey, CachedRuntimeName) && RuntimeNames.Contains(CachedRuntimeName))
+        {
+                SelectedRuntimeName = CachedRuntimeName;
+        }
+        else
+        {
+                const int32 Iterations = GetDefault<UNeuralAnimationToolkitSettings>()->AutotuneIterations;
+                double BestTime = TNumericLimits<double>::Max();
+
+                for (const FString& RuntimeName : RuntimeNames)
+                {
+                        const double Time = BenchmarkRuntime(WeakModelData, RuntimeName, Iterations);
+                        if (Time < 0.0)
+                        {
+                                continue;
+                        }
+
+                        UE_LOG(LogTemp, Display, TEXT("ModelRegistry: %s runs %s in %.3f ms"), *RuntimeName, *CacheKey, Time * 1000.0);
+                        if (Time < BestTime)
+                        {
+                                BestTime = Time;
+                                SelectedRuntimeName = RuntimeName;
+                        }
+                }
+
+                if (SelectedRuntimeName.IsEmpty())
+                {
+                        UE_LOG(LogTemp, Warning, TEXT("ModelRegistry: No runtime could run %s, falling back to %s"), *CacheKey, UNeuralAnimationToolkitSettings::DefaultRuntimeName);
+                        return UNeuralAnimationToolkitSettings::DefaultRuntimeName;
+                }
+
+                AutotuneCache->SetStringField(CacheKey, SelectedRuntimeName);
+                SaveAutotuneCache(AutotuneCache.ToSharedRef());
+
+                // The benchmark instances of the slower runtimes are not needed anymore
+                for (const FString& RuntimeName : RuntimeNames)
+                {
+                        if (RuntimeName != SelectedRuntimeName)
+                        {
+                                ReleaseRuntime(ObjectKey, RuntimeName);
+                        }
+                }
+        }
+
+        FScopeLock Lock(&EntriesCriticalSection);
+        SelectedRuntimes.Add(ObjectKey, SelectedRuntimeName);
+        return SelectedRuntimeName;
+}
+
+double FModelRegistry::BenchmarkRuntime(const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName, int32 Iterations)
+{
+        TSharedPtr<FModelEntry> Entry = ResolveEntry(WeakModelData, RuntimeName);
+        TSharedPtr<FModelInstance> Instance = Entry.IsValid() ? CreateInstance(Entry.ToSharedRef(), WeakModelData, RuntimeName) : nullptr;
+        if (!Instance.IsValid())
+        {
+                return -1.0;
+        }
+
+        // The first run allocates the runtime's buffers and is not timed
+        if (Instance->ModelInstance->RunSync(Instance->InputBindings, Instance->OutputBindings) != 0)
+        {
+                return -1.0;
+        }
+
+        TArray<double> Times;
+        Times.Reserve(Iterations);
+        for (int32 i = 0; i < FMath::Max(Iterations, 1); i++)
+        {
+                const double StartTime = FPlatformTime::Seconds();
+                Instance->ModelInstance->RunSync(Instance->InputBindings, Instance->OutputBindings);
+                Times.Add(FPlatformTime::Seconds() - StartTime);
+        }
+
+        // The instance is recycled once it goes out of scope, so the winner's instance is reused by the node that asked for it
+        Times.Sort();
+        return Times[Times.Num() / 2];
+}
+
+int32 FModelRegistry::NumPreloadedInstances(const UNNEModelData* ModelData, const FString& RuntimeName) const
+{
+        const FString KnownRuntimeName = RuntimeName.IsEmpty() ? FindSelectedRuntime(ModelData) : RuntimeName;
+        TSharedPtr<FModelEntry> Entry = KnownRuntimeName.IsEmpty() ? nullptr : FindEntry(ModelData, KnownRuntimeName);
+
+        FScopeLock Lock(&EntriesCriticalSection);
+        return Entry.IsValid() ? Entry->PreloadedInstances.Num() : 0;
+}
+
+void UModelRegistryLibrary::PreloadModel(UNNEModelData* ModelData, int32 NumInstances)
+{
+        FModelRegistry::Get().Preload(ModelData, NumInstances);
+}
+
+void UModelRegistryLibrary::ReleaseModel(UNNEModelData* ModelData)
+{
+        FModelRegistry::Get().Release(ModelData);
+}
+
+int32 UModelRegistryLibrary::GetNumPreloadedInstances(UNNEModelData* ModelData)
+{
+        return FModelRegistry::Get().NumPreloadedInstances(ModelData);
+}
@@ -0,0 +1,13 @@
+#include "NeuralAnimationToolkitSettings.h"
+
+const TCHAR* UNeuralAnimationToolkitSettings::DefaultRuntimeName = TEXT("NNERuntimeORTCpu");
+
+UNeuralAnimationToolkitSettings::UNeuralAnimationToolkitSettings()
+{
+        SectionName = TEXT("NeuralAnimationToolkit");
+}
+
+FName UNeuralAnimationToolkitSettings::GetCategoryName() const
+{
+        return TEXT("Plugins");
+}
@@ -1,240 +1,389 @@
 #include "SavGolFilter.h"
-#include "Algo/Reverse.h"
-#include "Math/UnrealMathUtility.h"
+#include "Misc/ScopeLock.h"
 
-// HandleBoundary remains unchanged
-int32 USavGolFilter::HandleBoundary(int32 Index, int32 Length, const FString& Mode)
+namespace
 {
-        if (Mode == "reflect")
+        struct FSavGolCoeffsKey
         {
-                if (Index < 0)
+                int32 WindowLength;
+                int32 PolyOrder;
+                int32 Deriv;
+                int32 Pos;
+
+                bool operator==(const FSavGolCoeffsKey& Other) const
                 {
-                        return -Index;
+                        return WindowLength == Other.WindowLength && PolyOrder == Other.PolyOrder && Deriv == Other.Deriv && Pos == Other.Pos;
                 }
-                else if (Index >= Length)
+
+                friend uint32 GetTypeHash(const FSavGolCoeffsKey& Key)
                 {
-                        return 2 * Length - Index - 2;
+                        return HashCombine(HashCombine(GetTypeHash(Key.WindowLength), GetTypeHash(Key.PolyOrder)), HashCombine(GetTypeHash(Key.Deriv), GetTypeHash(Key.Pos)));
                 }
-        }
-        else if (Mode == "constant")
+        };
+
+        // Output += Weight * Input over NumChannels floats
+        FORCEINLINE void AccumulateChannels(float* Output, const float* Input, float Weight, int32 NumChannels)
         {
-                if (Index < 0 || Index >= Length)
+                const VectorRegister4Float VectorWeight = VectorSetFloat1(Weight);
+                int32 Channel = 0;
+                for (; Channel + 4 <= NumChannels; Channel += 4)
                 {
-                        return -1; // Indicate out-of-bound for constant mode
+                        VectorStore(VectorMultiplyAdd(VectorWeight, VectorLoad(Input + Channel), VectorLoad(Output + Channel)), Output + Channel);
+                }
+                for (; Channel < NumChannels; ++Channel)
+                {
+                        Output[Channel] += Weight * Input[Channel];
                 }
         }
-        return Index;
 }
 
-TArray<FVector> USavGolFilter::Correlate1D(const TArray<FVector>& Input, const TArray<float>& Weights, int32 Axis, const FString& Mode, const FVector& CVal, int32 Origin)
+int32 USavGolFilter::HandleBoundary(int32 Index, int32 Length, ESavGolMode Mode)
 {
-        int32 InputLength = Input.Num();
-        int32 WeightsLength = Weights.Num();
+        if (Index >= 0 && Index < Length)
+        {
+                return Index;
+        }
 
-        if (WeightsLength <= 0)
+        switch (Mode)
         {
-                UE_LOG(LogTemp, Error, TEXT("No filter weights given."));
-                return TArray<FVector>();
+                case ESavGolMode::Mirror:
+                        return Index < 0 ? FMath::Min(-Index, Length - 1) : FMath::Max(2 * Length - Index - 2, 0);
+                case ESavGolMode::Nearest:
+                        return Index < 0 ? 0 : Length - 1;
+                default:
+                        return INDEX_NONE; // Out of bounds, the constant value is used
         }
+}
+
+const TArray<float>& USavGolFilter::GetCachedCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv, int32 Pos)
+{
+        static FCriticalSection CacheCriticalSection;
+        static TMap<FSavGolCoeffsKey, TUniquePtr<TArray<float>>> Cache;
 
-        if (Origin < -(WeightsLength / 2) || Origin >((WeightsLength - 1) / 2))
+        const FSavGolCoeffsKey Key = { WindowLength, PolyOrder, Deriv, Pos };
+
+        FScopeLock Lock(&CacheCriticalSection);
+        TUniquePtr<TArray<float>>& Coeffs = Cache.FindOrAdd(Key);
+        if (!Coeffs.IsValid())
         {
-                UE_LOG(LogTemp, Error, TEXT("Invalid origin; origin must satisfy -(len(weights) // 2) <= origin <= (len(weights)-1) // 2"));
-                return TArray<FVector>();
+                Coeffs = MakeUnique<TArray<float>>(LeastSquaresCoeffs(WindowLength, PolyOrder, Deriv, 1.0f, Pos));
         }
 
-        TArray<FVector> Output;
-        Output.SetNumZeroed(InputLength);
+        // The arrays are never removed, so the reference stays valid after the lock is released
+        return *Coeffs;
+}
 
-        for (int32 i = 0; i < InputLength; ++i)
+void USavGolFilter::FilterMatrix(const float* Input, float* Output, int32 NumFrames, int32 NumChannels, int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, ESavGolMode Mode, float Cval)
+{
+        if (NumFrames <= 0 || NumChannels <= 0)
+        {
+                return;
+        }
+
+        // Shorten the window to the data, keeping it odd
+        WindowLength = FMath::Min(WindowLength, NumFrames);
+        if (WindowLength % 2 == 0)
+        {
+                WindowLength -= 1;
+        }
+
+        if (WindowLength <= PolyOrder || WindowLength <= 0)
         {
-                FVector CorrelatedValue = FVector::ZeroVector;
-                for (int32 j = 0; j < WeightsLength; ++j)
+                // Not enough frames for a fit, pass the data through or return no change
+                if (Deriv == 0)
                 {
-                        int32 InputIndex = i + j + Origin;
-                        InputIndex = HandleBoundary(InputIndex, InputLength, Mode);
+                        FMemory::Memmove(Output, Input, static_cast<SIZE_T>(NumFrames) * NumChannels * sizeof(float));
+                }
+                else
+                {
+                        FMemory::Memzero(Output, static_cast<SIZE_T>(NumFrames) * NumChannels * sizeof(float));
+                }
+                return;
+        }
+
+        check(Input != Output);
+
+        const int32 HalfLen = WindowLength / 2;
+        const float Scale = 1.0f / FMath::Pow(Delta, static_cast<float>(Deriv));
+        const TArray<float>& Coeffs = GetCachedCoeffs(WindowLength, PolyOrder, Deriv, HalfLen);
+
+        FMemory::Memzero(Output, static_cast<SIZE_T>(NumFrames) * NumChannels * sizeof(float));
 
-                        if (InputIndex >= 0 && InputIndex < InputLength)
+        for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+        {
+                float* OutputFrame = Output + static_cast<int64>(Frame) * NumChannels;
+                const bool bIsEdge = Frame < HalfLen || Frame >= NumFrames - HalfLen;
+
+                if (!bIsEdge)
+                {
+                        for (int32 Tap = 0; Tap < WindowLength; ++Tap)
+                        {
+                                AccumulateChannels(OutputFrame, Input + static_cast<int64>(Frame - HalfLen + Tap) * NumChannels, Coeffs[Tap] * Scale, NumChannels);
+                        }
+                }
+                else if (Mode == ESavGolMode::Interp)
+                {
+                        // Fit over the first or last full window, evaluated at the position of this frame inside it
+                        const int32 WindowStart = Frame < HalfLen ? 0 : NumFrames - WindowLength;
+                        const TArray<float>& EdgeCoeffs = GetCachedCoeffs(WindowLength, PolyOrder, Deriv, Frame - WindowStart);
+                        for (int32 Tap = 0; Tap < WindowLength; ++Tap)
                         {
-                                CorrelatedValue += Input[InputIndex] * Weights[j];
+                                AccumulateChannels(OutputFrame, Input + static_cast<int64>(WindowStart + Tap) * NumChannels, EdgeCoeffs[Tap] * Scale, NumChannels);
                         }
-                        else if (Mode == "constant")
+                }
+                else
+                {
+                        float ConstantWeight = 0.0f;
+                        for (int32 Tap = 0; Tap < WindowLength; ++Tap)
+                        {
+                                const int32 SourceFrame = HandleBoundary(Frame - HalfLen + Tap, NumFrames, Mode);
+                                if (SourceFrame == INDEX_NONE)
+                                {
+                                        ConstantWeight += Coeffs[Tap] * Scale;
+                                }
+                                else
+                                {
+                                        AccumulateChannels(OutputFrame, Input + static_cast<int64>(SourceFrame) * NumChannels, Coeffs[Tap] * Scale, NumChannels);
+                                }
+                        }
+                        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
                         {
-                                CorrelatedValue += CVal * Weights[j]; // Apply Cval for out-of-bound indices in constant mode
+                                OutputFrame[Channel] += ConstantWeight * Cval;
                         }
                 }
-                Output[i] = CorrelatedValue;
         }
-
-        return Output;
 }
 
-TArray<FVector> USavGolFilter::Convolve1D(const TArray<FVector>& Input, TArray<float>& Weights, int32 Axis, const FString& Mode, const FVector& CVal, int32 Origin)
+TArray<FVector> USavGolFilter::SavGolFilter(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, ESavGolMode Mode, const FVector& Cval)
 {
-        Algo::Reverse(Weights);
-
-        Origin = -Origin;
-        if (Weights.Num() % 2 == 0)
+        if (WindowLength % 2 == 0 || WindowLength <= 0 || PolyOrder < 0 || WindowLength <= PolyOrder)
         {
-                Origin -= 1;
+                return TArray<FVector>();
         }
 
-        return Correlate1D(Input, Weights, Axis, Mode, CVal, Origin);
-}
-
-TArray<FVector> USavGolFilter::SavGolFilter(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, int32 Axis, const FString& Mode, const FVector& Cval)
-{
-        if (WindowLength % 2 == 0 || WindowLength <= 0 || PolyOrder < 0 || WindowLength <= PolyOrder)
+        if (Mode == ESavGolMode::Interp && WindowLength > X.Num())
         {
                 return TArray<FVector>();
         }
 
-        TArray<float> Coeffs = SavGolCoeffs(WindowLength, PolyOrder, Deriv, Delta);
+        const int32 NumFrames = X.Num();
+        TArray<float> Input;
+        Input.SetNumUninitialized(NumFrames * 3);
+        for (int32 i = 0; i < NumFrames; ++i)
+        {
+                Input[i * 3] = X[i].X;
+                Input[i * 3 + 1] = X[i].Y;
+                Input[i * 3 + 2] = X[i].Z;
+        }
 
-        TArray<FVector> Y;
-        Y.SetNum(X.Num());
+        TArray<float> Output;
+        Output.SetNumUninitialized(NumFrames * 3);
 
-        if (Mode == "interp")
+        // Constant mode needs one value per axis, so each axis is filtered on its own there
+        if (Mode == ESavGolMode::Constant)
         {
-                if (WindowLength > X.Num())
+                TArray<float> AxisInput;
+                TArray<float> AxisOutput;
+                AxisInput.SetNumUninitialized(NumFrames);
+                AxisOutput.SetNumUninitialized(NumFrames);
+                for (int32 Axis = 0; Axis < 3; ++Axis)
                 {
-                        return TArray<FVector>();
+                        for (int32 i = 0; i < NumFrames; ++i)
+                        {
+                                AxisInput[i] = Input[i * 3 + Axis];
+                        }
+                        FilterMatrix(AxisInput.GetData(), AxisOutput.GetData(), NumFrames, 1, WindowLength, PolyOrder, Deriv, Delta, Mode, Cval[Axis]);
+                        for (int32 i = 0; i < NumFrames; ++i)
+                        {
+                                Output[i * 3 + Axis] = AxisOutput[i];
+                        }
                 }
-
-                Y = Convolve1D(X, Coeffs, Axis, "constant", Cval);
-                FitEdgesPolyFit(X, WindowLength, PolyOrder, Deriv, Delta, Y);
         }
         else
         {
-                Y = Convolve1D(X, Coeffs, Axis, Mode, Cval);
+                FilterMatrix(Input.GetData(), Output.GetData(), NumFrames, 3, WindowLength, PolyOrder, Deriv, Delta, Mode);
+        }
+
+        TArray<FVector> Y;
+        Y.SetNumUninitialized(NumFrames);
+        for (int32 i = 0; i < NumFrames; ++i)
+        {
+                Y[i] = FVector(Output[i * 3], Output[i * 3 + 1], Output[i * 3 + 2]);
         }
 
         return Y;
 }
 
-// Other functions (SavGolCoeffs, FitEdgesPolyFit, FitEdge, PolyDer) remain largely the same,
-// except FitEdge and FitEdgesPolyFit should handle FVector operations.
-
-void USavGolFilter::FitEdgesPolyFit(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, TArray<FVector>& Y)
+TArray<float> USavGolFilter::LeastSquaresCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, int32 Pos)
 {
-        int32 HalfLen = WindowLength / 2;
-        FitEdge(X, 0, WindowLength, 0, HalfLen, -1, PolyOrder, Deriv, Delta, Y);
-        FitEdge(X, X.Num() - WindowLength, X.Num(), X.Num() - HalfLen, X.Num(), -1, PolyOrder, Deriv, Delta, Y);
-}
+        if (WindowLength <= 0 || PolyOrder < 0 || PolyOrder >= WindowLength || Deriv < 0)
+        {
+                UE_LOG(LogTemp, Error, TEXT("Invalid Savitzky-Golay parameters (window %d, order %d, derivative %d)"), WindowLength, PolyOrder, Deriv);
+                return TArray<float>();
+        }
 
-void USavGolFilter::FitEdge(const TArray<FVector>& X, int32 WindowStart, int32 WindowStop, int32 InterpStart, int32 InterpStop, int32 Axis, int32 PolyOrder, int32 Deriv, float Delta, TArray<FVector>& Y)
-{
-        TArray<FVector> XEdge = Slice(X, WindowStart, WindowStop - WindowStart);
+        if (Deriv > PolyOrder)
+        {
+                TArray<float> Zeros;
+                Zeros.SetNumZeroed(WindowLength);
+                return Zeros;
+        }
 
-        TArray<float> PolyCoeffs;
-        PolyCoeffs.SetNum(PolyOrder + 1);
+        if (Pos < 0)
+        {
+                Pos = WindowLength / 2;
+        }
 
-        for (int32 i = 0; i <= PolyOrder; ++i)
+        const int32 NumTerms = PolyOrder + 1;
+
+        // Normal equations (A^T A) z = e_deriv, A[i][k] = (i - Pos)^k
+        TArray<double> Normal;
+        Normal.SetNumZeroed(NumTerms * NumTerms);
+        for (int32 i = 0; i < WindowLength; ++i)
         {
-                FVector Sum = FVector::ZeroVector;
-                for (int32 j = 0; j < XEdge.Num(); ++j)
+                const double T = i - Pos;
+                for (int32 Row = 0; Row < NumTerms; ++Row)
                 {
-                        Sum += XEdge[j] * FMath::Pow(static_cast<float>(j), static_cast<float>(i));
+                        for (int32 Col = 0; Col < NumTerms; ++Col)
+                        {
+                                Normal[Row * NumTerms + Col] += FMath::Pow(T, static_cast<double>(Row + Col));
+                        }
                 }
-                PolyCoeffs[i] = Sum.Size(); // Assuming we're summing the size of vectors; adapt as needed
         }
 
-        if (Deriv > 0)
+        TArray<double> Z;
+        Z.SetNumZeroed(NumTerms);
+        Z[Deriv] = 1.0;
+
+        // Gaussian elimination with partial pivoting
+        for (int32 Col = 0; Col < NumTerms; ++Col)
         {
-                PolyCoeffs = PolyDer(PolyCoeffs, Deriv);
+                int32 Pivot = Col;
+                for (int32 Row = Col + 1; Row < NumTerms; ++Row)
+                {
+                        if (FMath::Abs(Normal[Row * NumTerms + Col]) > FMath::Abs(Normal[Pivot * NumTerms + Col]))
+                        {
+                                Pivot = Row;
+                        }
+                }
+                if (Pivot != Col)
+                {
+                        for (int32 k = 0; k < NumTerms; ++k)
+                        {
+                                Swap(Normal[Col * NumTerms + k], Normal[Pivot * NumTerms + k]);
+                        }
+                        Swap(Z[Col], Z[Pivot]);
+                }
+
+                for (int32 Row = Col + 1; Row < NumTerms; ++Row)
+                {
+                        const double Factor = Normal[Row * NumTerms + Col] / Normal[Col * NumTerms + Col];
+                        for (int32 k = Col; k < NumTerms; ++k)
+                        {
+                                Normal[Row * NumTerms + k] -= Factor * Normal[Col * NumTerms + k];
+                        }
+                        Z[Row] -= Factor * Z[Col];
+                }
         }
 
-        TArray<FVector> Values;
-        for (int32 i = InterpStart - WindowStart; i < InterpStop - WindowStart; ++i)
+        for (int32 Row = NumTerms - 1; Row >= 0; --Row)
         {
-                FVector Val = FVector::ZeroVector;
-                for (int32 j = 0; j < PolyCoeffs.Num(); ++j)
+                for (int32 k = Row + 1; k < NumTerms; ++k)
                 {
-                        Val += FVector(PolyCoeffs[j]) * FMath::Pow(static_cast<float>(i), static_cast<float>(j));
+                        Z[Row] -= Normal[Row * NumTerms + k] * Z[k];
                 }
-                Values.Add(Val / FMath::Pow(Delta, static_cast<float>(Deriv)));
+                Z[Row] /= Normal[Row * NumTerms + Row];
         }
 
-        for (int32 i = InterpStart; i < InterpStop; ++i)
+        // Derivative of the fitted polynomial at Pos, scaled by deriv! / delta^deriv
+        double Scale = 1.0 / FMath::Pow(static_cast<double>(Delta), static_cast<double>(Deriv));
+        for (int32 k = 2; k <= Deriv; ++k)
         {
-                Y[i] = Values[i - InterpStart];
+                Scale *= k;
         }
-}
 
-TArray<FVector> USavGolFilter::Slice(const TArray<FVector>& array, int32 start, int32 stop)
-{
-        TArray<FVector> result;
-        for (int32 i = start; i < stop; i++)
+        TArray<float> Coeffs;
+        Coeffs.SetNum(WindowLength);
+        for (int32 i = 0; i < WindowLength; ++i)
         {
-                result.Add(array[i]);
+                const double T = i - Pos;
+                double Sum = 0.0;
+                for (int32 k = 0; k < NumTerms; ++k)
+                {
+                        Sum += Z[k] * FMath::Pow(T, static_cast<double>(k));
+                }
+                Coeffs[i] = static_cast<float>(Sum * Scale);
         }
-        return result;
+
+        return Coeffs;
 }
 
-// PolyDer and SavGolCoeffs remain the same
+void FStreamingSavGolFilter::Initialize(int32 InNumChannels, int32 InWindowLength, int32 InPolyOrder, int32 InLatency)
+{
+        NumChannels = InNumChannels;
+        WindowLength = FMath::Max(InWindowLength, InPolyOrder + 1);
+        Latency = FMath::Clamp(InLatency, 0, WindowLength - 1);
+
+        const int32 Pos = WindowLength - 1 - Latency;
+        Coefficients = USavGolFilter::GetCachedCoeffs(WindowLength, InPolyOrder, 0, Pos);
+        DerivativeCoefficients = USavGolFilter::GetCachedCoeffs(WindowLength, InPolyOrder, 1, Pos);
 
-TArray<float> USavGolFilter::SavGolCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, int32 Pos, const FString& Use)
+        History.SetNumZeroed(WindowLength * NumChannels);
+        Reset();
+}
+
+void FStreamingSavGolFilter::Reset()
 {
-    if (PolyOrder >= WindowLength)
-    {
-        // Handle error
-        return TArray<float>();
-    }
-
-    int32 HalfLen = WindowLength / 2;
-    if (Pos == -1)
-    {
-        Pos = (WindowLength % 2 == 0) ? HalfLen - 1 : HalfLen;
-    }
-
-    TArray<float> X;
-    for (int32 i = -Pos; i < WindowLength - Pos; ++i)
-    {
-        X.Add(i);
-    }
-
-    if (Use == "conv")
-    {
-        Algo::Reverse(X);
-    }
-
-    TArray<float> Y;
-    Y.SetNumZeroed(PolyOrder + 1);
-    Y[Deriv] = FMath::Pow(Delta, -Deriv);
-
-    TArray<float> Coeffs;
-    Coeffs.SetNum(WindowLength);
-
-    for (int32 i = 0; i < WindowLength; ++i)
-    {
-        float Sum = 0.0f;
-        for (int32 j = 0; j <= PolyOrder; ++j)
-        {
-            float Term = 1.0f;
-            for (int32 k = 0; k < j; ++k)
-            {
-                Term *= X[i];
-            }
-            Sum += Term * Y[j];
-        }
-        Coeffs[i] = Sum;
-    }
-
-    return Coeffs;
+        Head = 0;
+        bHasSamples = false;
 }
 
-TArray<float> USavGolFilter::PolyDer(const TArray<float>& P, int32 M)
+void FStreamingSavGolFilter::Update(TArray<float>& Values, float DeltaTime, TArray<float>* OutDerivatives)
 {
-    TArray<float> Result = P;
+        check(Values.Num() >= NumChannels);
+
+        if (!bHasSamples)
+        {
+                for (int32 i = 0; i < WindowLength; ++i)
+                {
+                        FMemory::Memcpy(History.GetData() + i * NumChannels, Values.GetData(), NumChannels * sizeof(float));
+                }
+                bHasSamples = true;
+        }
+        else
+        {
+                // The oldest sample is replaced by the new one which becomes the newest
+                FMemory::Memcpy(History.GetData() + Head * NumChannels, Values.GetData(), NumChannels * sizeof(float));
+                Head = (Head + 1) % WindowLength;
+        }
 
-    for (int32 m = 0; m < M; ++m)
-    {
-        for (int32 i = 0; i < Result.Num() - 1; ++i)
+        if (OutDerivatives)
         {
-            Result[i] = Result[i] * (Result.Num() - 1 - i);
+                OutDerivatives->SetNumZeroed(NumChannels);
         }
-        Result.Pop();
-    }
 
-    return Result;
-}
+        float* Output = Values.GetData();
+        FMemory::Memzero(Output, NumChannels * sizeof(float));
+
+        // Tap by tap so the inner loop runs over contiguous channels
+        const float InvDeltaTime = DeltaTime > 0.0f ? 1.0f / DeltaTime : 0.0f;
+        for (int32 Tap = 0; Tap < WindowLength; ++Tap)
+        {
+                const float* Sample = History.GetData() + ((Head + Tap) % WindowLength) * NumChannels;
+                const float Weight = Coefficients[Tap];
+                for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+                {
+                        Output[Channel] += Weight * Sample[Channel];
+                }
+
+                if (OutDerivatives)
+                {
+                        const float DerivativeWeight = DerivativeCoefficients[Tap] * InvDeltaTime;
+                        float* Derivatives = OutDerivatives->GetData();
+                        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+                        {
+                                Derivatives[Channel] += DerivativeWeight * Sample[Channel];
+                        }
+                }
+        }
+}
\ No newline at end of file
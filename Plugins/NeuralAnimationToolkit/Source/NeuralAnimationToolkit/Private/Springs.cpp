@@ -1,176 +1,177 @@
 #include "Springs.h"
 
-FSpring::FSpring(int prev_size, float x_gain, float v_gain, float a_gain)
+namespace
 {
-        this->x = x;
-        this->v = v;
-        this->x_gain = x_gain;
-        this->v_gain = v_gain;
-        this->a_gain = a_gain;
+        enum ESpringBankStream : int32
+        {
+                PositionX, PositionY, PositionZ,
+                VelocityX, VelocityY, VelocityZ,
+                RotationX, RotationY, RotationZ, RotationW,
+                AngularVelocityX, AngularVelocityY, AngularVelocityZ,
+                GoalPositionX, GoalPositionY, GoalPositionZ,
+                GoalRotationX, GoalRotationY, GoalRotationZ, GoalRotationW,
+                NumStreams
+        };
+
+        constexpr float SpringBankEps = 1e-8f;
+
+        enum ETrackingSpringStream : int32
+        {
+                TrackingStreamPosition,
+                TrackingStreamVelocity,
+                TrackingStreamGoal,
+                TrackingStreamHistory, // FTrackingSpringBank::HistorySize streams from here
+        };
+
+        // Same decay as FVectorSpring::Update for one axis of four bones
+        FORCEINLINE void UpdateSpringAxis(float* X, float* V, const float* G, const VectorRegister4Float& Y,
+                const VectorRegister4Float& A, const VectorRegister4Float& B, const VectorRegister4Float& C)
+        {
+                const VectorRegister4Float Goal = VectorLoadAligned(G);
+                const VectorRegister4Float Velocity = VectorLoadAligned(V);
+                const VectorRegister4Float J0 = VectorSubtract(VectorLoadAligned(X), Goal);
+                const VectorRegister4Float J1 = VectorMultiplyAdd(J0, Y, Velocity);
 
-        this->prev_size = prev_size;
-        this->g_prev = new float[prev_size];
+                VectorStoreAligned(VectorMultiplyAdd(A, J0, VectorMultiplyAdd(B, J1, Goal)), X);
+                VectorStoreAligned(VectorNegateMultiplyAdd(C, J1, VectorMultiply(A, Velocity)), V);
+        }
 }
 
-void FSpring::update(float g, const float dt)
+FTrackingSpringBank::FTrackingSpringBank(float InXGain, float InVGain, float InAGain)
+        : x_gain(InXGain)
+        , v_gain(InVGain)
+        , a_gain(InAGain)
 {
-        for (int i = prev_size - 1; i > 0; i--)
-        {
-                g_prev[i] = g_prev[i - 1];
-        }
-
-        float x_goal = g;
-        float v_goal = FMath::Clamp(tracking_target_velocity(g, g_prev[1], dt), -v_max, v_max);
-        float a_goal = FMath::Clamp(tracking_target_acceleration(g, g_prev[1], g_prev[2], dt), -a_max, a_max);
-
-        tracking_spring_update_exact(
-                x_goal,
-                v_goal,
-                a_goal,
-                dt,
-                dt);
-
-        g_prev[0] = g;
-
 }
 
-void FSpring::tracking_spring_update_exact(
-        float x_goal,
-        float v_goal,
-        float a_goal,
-        const float dt,
-        float gain_dt)
+void FTrackingSpringBank::Initialize(int32 InNumChannels)
 {
-        float t0 = (1.0f - v_gain) * (1.0f - x_gain);
-        float t1 = a_gain * (1.0f - v_gain) * (1.0f - x_gain);
-        float t2 = (v_gain * (1.0f - x_gain)) / gain_dt;
-        float t3 = x_gain / (gain_dt * gain_dt);
-
-        float stiffness = t3;
-        float damping = (1.0f - t0) / gain_dt;
-        float spring_x_goal = x_goal;
-        float spring_v_goal = (t2 * v_goal + t1 * a_goal) / ((1.0f - t0) / gain_dt);
-
-        spring_damper_exact_stiffness_damping(
-                spring_x_goal,
-                spring_v_goal,
-                stiffness,
-                damping,
-                dt);
+        NumChannels = InNumChannels;
+        PaddedNumChannels = Align(InNumChannels, 4);
+        Streams.SetNumZeroed(PaddedNumChannels * (TrackingStreamHistory + HistorySize));
+        HistoryHead = 0;
+        bHasState = false;
 }
 
-void FSpring::tracking_spring_update_no_acceleration_exact(
-        float x_goal,
-        float v_goal,
-        const float dt,
-        float gain_dt)
+void FTrackingSpringBank::Reset()
 {
-        float t0 = (1.0f - v_gain) * (1.0f - x_gain);
-        float t2 = (v_gain * (1.0f - x_gain)) / gain_dt;
-        float t3 = x_gain / (gain_dt * gain_dt);
-
-        float stiffness = t3;
-        float damping = (1.0f - t0) / gain_dt;
-        float spring_x_goal = x_goal;
-        float spring_v_goal = t2 * v_goal / ((1.0f - t0) / gain_dt);
-
-        spring_damper_exact_stiffness_damping(
-                spring_x_goal,
-                spring_v_goal,
-                stiffness,
-                damping,
-                dt);
+        bHasState = false;
 }
 
-void FSpring::tracking_spring_update_no_velocity_acceleration_exact(
-        float x_goal,
-        const float dt,
-        float gain_dt)
+void FTrackingSpringBank::Update(TArray<float>& Values, const float dt)
 {
-        float t0 = 1.0f - x_gain;
-        float t3 = x_gain / (gain_dt * gain_dt);
+        check(Values.Num() >= NumChannels);
 
-        float stiffness = t3;
-        float damping = (1.0f - t0) / gain_dt;
-        float spring_x_goal = x_goal;
-        float spring_v_goal = 0.0f;
+        // The spring transition divides by dt, without elapsed time the state and the values stay as they are
+        if (dt <= 0.0f)
+        {
+                return;
+        }
 
-        spring_damper_exact_stiffness_damping(
-                spring_x_goal,
-                spring_v_goal,
-                stiffness,
-                damping,
-                dt);
-}
+        float* X = GetStream(TrackingStreamPosition);
+        float* V = GetStream(TrackingStreamVelocity);
+        float* G = GetStream(TrackingStreamGoal);
+        FMemory::Memcpy(G, Values.GetData(), NumChannels * sizeof(float));
 
-float FSpring::tracking_target_acceleration(
-        float x_next,
-        float x_curr,
-        float x_prev,
-        const float dt)
-{
-        return (((x_next - x_curr) / dt) - ((x_curr - x_prev) / dt)) / dt;
-}
+        // The ring holds the previous goal at HistoryHead and older goals before it
+        float* Prev = GetStream(TrackingStreamHistory + HistoryHead);
+        float* PrevPrev = GetStream(TrackingStreamHistory + (HistoryHead + HistorySize - 1) % HistorySize);
 
-float FSpring::tracking_target_velocity(
-        float x_next,
-        float x_curr,
-        const float dt)
-{
-        return (x_next - x_curr) / dt;
-}
-
-void FSpring::spring_damper_exact_stiffness_damping(
-        float x_goal,
-        float v_goal,
-        float stiffness,
-        float damping,
-        const float dt,
-        float eps)
-{
-        float g = x_goal;
-        float q = v_goal;
-        float s = stiffness;
-        float d = damping;
-        float c = g + (d * q) / (s + eps);
-        float y = d / 2.0f;
+        if (!bHasState)
+        {
+                FMemory::Memcpy(X, G, PaddedNumChannels * sizeof(float));
+                FMemory::Memzero(V, PaddedNumChannels * sizeof(float));
+                for (int32 i = 0; i < HistorySize; i++)
+                {
+                        FMemory::Memcpy(GetStream(TrackingStreamHistory + i), G, PaddedNumChannels * sizeof(float));
+                }
+                bHasState = true;
+                return;
+        }
 
+        // Spring parameters are shared by all channels, so the closed form transition of the offset from the goal
+        // [x - c, v] -> M * [x - c, v] only has to be computed once
+        const float eps = 1e-5f;
+        const float gain_dt = dt;
+        const float t0 = (1.0f - v_gain) * (1.0f - x_gain);
+        const float t1 = a_gain * (1.0f - v_gain) * (1.0f - x_gain);
+        const float t2 = (v_gain * (1.0f - x_gain)) / gain_dt;
+        const float s = x_gain / (gain_dt * gain_dt);
+        const float d = (1.0f - t0) / gain_dt;
+        const float y = d / 2.0f;
+
+        float m00, m01, m10, m11;
         if (FMath::Abs(s - (d * d) / 4.0f) < eps) // Critically Damped
         {
-                float j0 = x - c;
-                float j1 = v + j0 * y;
-
-                float eydt = FMath::Exp(-y * dt);
-
-                x = j0 * eydt + dt * j1 * eydt + c;
-                v = -y * j0 * eydt - y * dt * j1 * eydt + j1 * eydt;
+                const float eydt = FMath::Exp(-y * dt);
+                m00 = eydt * (1.0f + y * dt);
+                m01 = eydt * dt;
+                m10 = -eydt * y * y * dt;
+                m11 = eydt * (1.0f - y * dt);
         }
-        else if (s - (d * d) / 4.0f > 0.0) // Under Damped
+        else if (s - (d * d) / 4.0f > 0.0f) // Under Damped
         {
-                float w = FMath::Sqrt(s - (d * d) / 4.0f);
-                float j = FMath::Sqrt(FMath::Square(v + y * (x - c)) / (w * w + eps) + FMath::Square(x - c));
-                float p = FMath::Atan((v + (x - c) * y) / (-(x - c) * w + eps));
-
-                j = (x - c) > 0.0f ? j : -j;
-
-                float eydt = FMath::Exp(-y * dt);
-
-                x = j * eydt * FMath::Cos(w * dt + p) + c;
-                v = -y * j * eydt * FMath::Cos(w * dt + p) - w * j * eydt * FMath::Sin(w * dt + p);
+                const float w = FMath::Sqrt(s - (d * d) / 4.0f);
+                const float eydt = FMath::Exp(-y * dt);
+                float sinwdt, coswdt;
+                FMath::SinCos(&sinwdt, &coswdt, w * dt);
+                m00 = eydt * (coswdt + y * sinwdt / w);
+                m01 = eydt * sinwdt / w;
+                m10 = -eydt * s * sinwdt / w;
+                m11 = eydt * (coswdt - y * sinwdt / w);
         }
-        else if (s - (d * d) / 4.0f < 0.0) // Over Damped
+        else // Over Damped
         {
-                float y0 = (d + FMath::Sqrt(d * d - 4 * s)) / 2.0f;
-                float y1 = (d - FMath::Sqrt(d * d - 4 * s)) / 2.0f;
-                float j1 = (c * y0 - x * y0 - v) / (y1 - y0);
-                float j0 = x - j1 - c;
-
-                float ey0dt = FMath::Exp(-y0 * dt);
-                float ey1dt = FMath::Exp(-y1 * dt);
+                const float y0 = (d + FMath::Sqrt(d * d - 4.0f * s)) / 2.0f;
+                const float y1 = (d - FMath::Sqrt(d * d - 4.0f * s)) / 2.0f;
+                const float ey0dt = FMath::Exp(-y0 * dt);
+                const float ey1dt = FMath::Exp(-y1 * dt);
+                m00 = (y0 * ey1dt - y1 * ey0dt) / (y0 - y1);
+                m01 = (ey1dt - ey0dt) / (y0 - y1);
+                m10 = y0 * y1 * (ey0dt - ey1dt) / (y0 - y1);
+                m11 = (y0 * ey0dt - y1 * ey1dt) / (y0 - y1);
+        }
 
-                x = j0 * ey0dt + j1 * ey1dt + c;
-                v = -y0 * j0 * ey0dt - y1 * j1 * ey1dt;
+        const VectorRegister4Float M00 = VectorSetFloat1(m00);
+        const VectorRegister4Float M01 = VectorSetFloat1(m01);
+        const VectorRegister4Float M10 = VectorSetFloat1(m10);
+        const VectorRegister4Float M11 = VectorSetFloat1(m11);
+        const VectorRegister4Float InvDt = VectorSetFloat1(1.0f / dt);
+        const VectorRegister4Float VMax = VectorSetFloat1(v_max);
+        const VectorRegister4Float AMax = VectorSetFloat1(a_max);
+        const VectorRegister4Float VGoalScale = VectorSetFloat1(t2 / d);
+        const VectorRegister4Float AGoalScale = VectorSetFloat1(t1 / d);
+        const VectorRegister4Float GoalOffsetScale = VectorSetFloat1(d / (s + eps));
+
+        for (int32 i = 0; i < PaddedNumChannels; i += 4)
+        {
+                const VectorRegister4Float Goal = VectorLoadAligned(G + i);
+                const VectorRegister4Float PrevGoal = VectorLoadAligned(Prev + i);
+                const VectorRegister4Float PrevPrevGoal = VectorLoadAligned(PrevPrev + i);
+
+                // Clamped tracking targets
+                const VectorRegister4Float VelocityGoal = VectorMultiply(VectorSubtract(Goal, PrevGoal), InvDt);
+                const VectorRegister4Float PrevVelocityGoal = VectorMultiply(VectorSubtract(PrevGoal, PrevPrevGoal), InvDt);
+                const VectorRegister4Float AccelerationGoal = VectorMultiply(VectorSubtract(VelocityGoal, PrevVelocityGoal), InvDt);
+                const VectorRegister4Float ClampedVelocityGoal = VectorMin(VectorMax(VelocityGoal, VectorNegate(VMax)), VMax);
+                const VectorRegister4Float ClampedAccelerationGoal = VectorMin(VectorMax(AccelerationGoal, VectorNegate(AMax)), AMax);
+
+                // Position the spring settles at
+                const VectorRegister4Float SpringVelocityGoal = VectorMultiplyAdd(VGoalScale, ClampedVelocityGoal, VectorMultiply(AGoalScale, ClampedAccelerationGoal));
+                const VectorRegister4Float C = VectorMultiplyAdd(GoalOffsetScale, SpringVelocityGoal, Goal);
+
+                const VectorRegister4Float Offset = VectorSubtract(VectorLoadAligned(X + i), C);
+                const VectorRegister4Float Velocity = VectorLoadAligned(V + i);
+
+                VectorStoreAligned(VectorAdd(C, VectorMultiplyAdd(M00, Offset, VectorMultiply(M01, Velocity))), X + i);
+                VectorStoreAligned(VectorMultiplyAdd(M10, Offset, VectorMultiply(M11, Velocity)), V + i);
         }
+
+        // The oldest goal is overwritten by the current one which becomes the head
+        HistoryHead = (HistoryHead + 1) % HistorySize;
+        FMemory::Memcpy(GetStream(TrackingStreamHistory + HistoryHead), G, PaddedNumChannels * sizeof(float));
+
+        FMemory::Memcpy(Values.GetData(), X, NumChannels * sizeof(float));
 }
 
 FVectorSpring::FVectorSpring(float HalfLife)
@@ -233,3 +234,282 @@ void FTransformSpring::Update(FTransform& g, const float dt, bool isDebug)
 
         g = FTransform(Rot, Pos);
 }
+
+
+FTransformSpringBank::FTransformSpringBank(float HalfLife)
+{
+        this->halfLife = HalfLife;
+}
+
+void FTransformSpringBank::Initialize(int32 InNumBones)
+{
+        NumBones = InNumBones;
+        PaddedNumBones = Align(InNumBones, 4);
+        Streams.SetNumZeroed(PaddedNumBones * NumStreams);
+
+        // Padding lanes hold identity rotations so the quaternion kernels stay finite
+        for (int32 i = NumBones; i < PaddedNumBones; i++)
+        {
+                GetStream(RotationW)[i] = 1.0f;
+                GetStream(GoalRotationW)[i] = 1.0f;
+        }
+
+        bHasState = false;
+}
+
+void FTransformSpringBank::Reset()
+{
+        bHasState = false;
+}
+
+void FTransformSpringBank::Update(TArray<FVector>& Positions, TArray<FQuat>& Rotations, const float dt)
+{
+        check(Positions.Num() >= NumBones && Rotations.Num() >= NumBones);
+
+        float* GoalPosition[3] = { GetStream(GoalPositionX), GetStream(GoalPositionY), GetStream(GoalPositionZ) };
+        float* GoalRotation[4] = { GetStream(GoalRotationX), GetStream(GoalRotationY), GetStream(GoalRotationZ), GetStream(GoalRotationW) };
+        float* Position[3] = { GetStream(PositionX), GetStream(PositionY), GetStream(PositionZ) };
+        float* Velocity[3] = { GetStream(VelocityX), GetStream(VelocityY), GetStream(VelocityZ) };
+        float* Rotation[4] = { GetStream(RotationX), GetStream(RotationY), GetStream(RotationZ), GetStream(RotationW) };
+        float* AngularVelocity[3] = { GetStream(AngularVelocityX), GetStream(AngularVelocityY), GetStream(AngularVelocityZ) };
+
+        for (int32 i = 0; i < NumBones; i++)
+        {
+                GoalPosition[0][i] = Positions[i].X;
+                GoalPosition[1][i] = Positions[i].Y;
+                GoalPosition[2][i] = Positions[i].Z;
+                GoalRotation[0][i] = Rotations[i].X;
+                GoalRotation[1][i] = Rotations[i].Y;
+                GoalRotation[2][i] = Rotations[i].Z;
+                GoalRotation[3][i] = Rotations[i].W;
+        }
+
+        // Start from the goal rather than from the origin
+        if (!bHasState)
+        {
+                for (int32 Axis = 0; Axis < 3; Axis++)
+                {
+                        FMemory::Memcpy(Position[Axis], GoalPosition[Axis], PaddedNumBones * sizeof(float));
+                        FMemory::Memzero(Velocity[Axis], PaddedNumBones * sizeof(float));
+                        FMemory::Memzero(AngularVelocity[Axis], PaddedNumBones * sizeof(float));
+                }
+                for (int32 Axis = 0; Axis < 4; Axis++)
+                {
+                        FMemory::Memcpy(Rotation[Axis], GoalRotation[Axis], PaddedNumBones * sizeof(float));
+                }
+                bHasState = true;
+                return;
+        }
+
+        const float y = (6.64f * 0.69314718056f / halfLife) / 2.0f;
+        const float eydt = FMath::Exp(-y * dt);
+
+        const VectorRegister4Float Y = VectorSetFloat1(y);
+        const VectorRegister4Float A = VectorSetFloat1(eydt);
+        const VectorRegister4Float B = VectorSetFloat1(eydt * dt);
+        const VectorRegister4Float C = VectorSetFloat1(eydt * y * dt);
+        const VectorRegister4Float Zero = VectorZeroFloat();
+        const VectorRegister4Float Half = VectorSetFloat1(0.5f);
+        const VectorRegister4Float Two = VectorSetFloat1(2.0f);
+        const VectorRegister4Float Eps = VectorSetFloat1(SpringBankEps);
+
+        for (int32 i = 0; i < PaddedNumBones; i += 4)
+        {
+                for (int32 Axis = 0; Axis < 3; Axis++)
+                {
+                        UpdateSpringAxis(Position[Axis] + i, Velocity[Axis] + i, GoalPosition[Axis] + i, Y, A, B, C);
+                }
+
+                const VectorRegister4Float GX = VectorLoadAligned(GoalRotation[0] + i);
+                const VectorRegister4Float GY = VectorLoadAligned(GoalRotation[1] + i);
+                const VectorRegister4Float GZ = VectorLoadAligned(GoalRotation[2] + i);
+                const VectorRegister4Float GW = VectorLoadAligned(GoalRotation[3] + i);
+                VectorRegister4Float QX = VectorLoadAligned(Rotation[0] + i);
+                VectorRegister4Float QY = VectorLoadAligned(Rotation[1] + i);
+                VectorRegister4Float QZ = VectorLoadAligned(Rotation[2] + i);
+                VectorRegister4Float QW = VectorLoadAligned(Rotation[3] + i);
+
+                // Rotate the shorter way around
+                const VectorRegister4Float Dot = VectorMultiplyAdd(QX, GX, VectorMultiplyAdd(QY, GY, VectorMultiplyAdd(QZ, GZ, VectorMultiply(QW, GW))));
+                const VectorRegister4Float Flip = VectorCompareLT(Dot, Zero);
+                QX = VectorSelect(Flip, VectorNegate(QX), QX);
+                QY = VectorSelect(Flip, VectorNegate(QY), QY);
+                QZ = VectorSelect(Flip, VectorNegate(QZ), QZ);
+                QW = VectorSelect(Flip, VectorNegate(QW), QW);
+
+                // Difference Q * G.Inverse()
+                const VectorRegister4Float DX = VectorSubtract(VectorSubtract(VectorMultiply(QX, GW), VectorMultiply(QW, GX)), VectorSubtract(VectorMultiply(QY, GZ), VectorMultiply(QZ, GY)));
+                const VectorRegister4Float DY = VectorSubtract(VectorSubtract(VectorMultiply(QY, GW), VectorMultiply(QW, GY)), VectorSubtract(VectorMultiply(QZ, GX), VectorMultiply(QX, GZ)));
+                const VectorRegister4Float DZ = VectorSubtract(VectorSubtract(VectorMultiply(QZ, GW), VectorMultiply(QW, GZ)), VectorSubtract(VectorMultiply(QX, GY), VectorMultiply(QY, GX)));
+                const VectorRegister4Float DW = VectorMultiplyAdd(QW, GW, VectorMultiplyAdd(QX, GX, VectorMultiplyAdd(QY, GY, VectorMultiply(QZ, GZ))));
+
+                // Scaled angle axis of the difference, 2 * log(D)
+                const VectorRegister4Float Length = VectorSqrt(VectorMultiplyAdd(DX, DX, VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ))));
+                const VectorRegister4Float LogScale = VectorSelect(VectorCompareGT(Length, Eps),
+                        VectorDivide(VectorMultiply(Two, VectorATan2(Length, DW)), VectorMax(Length, Eps)), Two);
+
+                VectorRegister4Float ScaledAngleAxis[3];
+                const VectorRegister4Float D[3] = { DX, DY, DZ };
+                for (int32 Axis = 0; Axis < 3; Axis++)
+                {
+                        const VectorRegister4Float J0 = VectorMultiply(D[Axis], LogScale);
+                        const VectorRegister4Float W = VectorLoadAligned(AngularVelocity[Axis] + i);
+                        const VectorRegister4Float J1 = VectorMultiplyAdd(J0, Y, W);
+
+                        // Halved here already as the exponential map below works on half angles
+                        ScaledAngleAxis[Axis] = VectorMultiply(Half, VectorMultiplyAdd(A, J0, VectorMultiply(B, J1)));
+                        VectorStoreAligned(VectorNegateMultiplyAdd(C, J1, VectorMultiply(A, W)), AngularVelocity[Axis] + i);
+                }
+
+                // E = exp(ScaledAngleAxis / 2)
+                const VectorRegister4Float HalfAngle = VectorSqrt(VectorMultiplyAdd(ScaledAngleAxis[0], ScaledAngleAxis[0],
+                        VectorMultiplyAdd(ScaledAngleAxis[1], ScaledAngleAxis[1], VectorMultiply(ScaledAngleAxis[2], ScaledAngleAxis[2]))));
+                VectorRegister4Float Sin;
+                VectorRegister4Float Cos;
+                VectorSinCos(&Sin, &Cos, &HalfAngle);
+                const VectorRegister4Float Sinc = VectorSelect(VectorCompareGT(HalfAngle, Eps), VectorDivide(Sin, VectorMax(HalfAngle, Eps)), VectorOneFloat());
+
+                const VectorRegister4Float EX = VectorMultiply(ScaledAngleAxis[0], Sinc);
+                const VectorRegister4Float EY = VectorMultiply(ScaledAngleAxis[1], Sinc);
+                const VectorRegister4Float EZ = VectorMultiply(ScaledAngleAxis[2], Sinc);
+                const VectorRegister4Float EW = Cos;
+
+                // Q = E * G
+                QX = VectorAdd(VectorAdd(VectorMultiply(EW, GX), VectorMultiply(EX, GW)), VectorSubtract(VectorMultiply(EY, GZ), VectorMultiply(EZ, GY)));
+                QY = VectorAdd(VectorAdd(VectorMultiply(EW, GY), VectorMultiply(EY, GW)), VectorSubtract(VectorMultiply(EZ, GX), VectorMultiply(EX, GZ)));
+                QZ = VectorAdd(VectorAdd(VectorMultiply(EW, GZ), VectorMultiply(EZ, GW)), VectorSubtract(VectorMultiply(EX, GY), VectorMultiply(EY, GX)));
+                QW = VectorSubtract(VectorMultiply(EW, GW), VectorMultiplyAdd(EX, GX, VectorMultiplyAdd(EY, GY, VectorMultiply(EZ, GZ))));
+
+                const VectorRegister4Float InvLength = VectorReciprocalSqrt(VectorMultiplyAdd(QX, QX, VectorMultiplyAdd(QY, QY, VectorMultiplyAdd(QZ, QZ, VectorMultiply(QW, QW)))));
+                VectorStoreAligned(VectorMultiply(QX, InvLength), Rotation[0] + i);
+                VectorStoreAligned(VectorMultiply(QY, InvLength), Rotation[1] + i);
+                VectorStoreAligned(VectorMultiply(QZ, InvLength), Rotation[2] + i);
+                VectorStoreAligned(VectorMultiply(QW, InvLength), Rotation[3] + i);
+        }
+
+        for (int32 i = 0; i < NumBones; i++)
+        {
+                Positions[i] = FVector(Position[0][i], Position[1][i], Position[2][i]);
+                Rotations[i] = FQuat(Rotation[0][i], Rotation[1][i], Rotation[2][i], Rotation[3][i]);
+        }
+}
+
+FOffsetInertializer::FOffsetInertializer(float HalfLife)
+{
+        this->halfLife = HalfLife;
+}
+
+void FOffsetInertializer::Initialize(int32 InNumBones)
+{
+        Bones.SetNum(InNumBones);
+        PrevPositions.SetNum(InNumBones);
+        PrevRotations.SetNum(InNumBones);
+        PrevGoalPositions.SetNum(InNumBones);
+        PrevGoalRotations.SetNum(InNumBones);
+        Reset();
+}
+
+void FOffsetInertializer::Reset()
+{
+        for (FBoneOffset& Bone : Bones)
+        {
+                Bone = FBoneOffset();
+        }
+        ActiveBones.Reset();
+        bHasState = false;
+}
+
+void FOffsetInertializer::CaptureOffset(int32 BoneIndex, const FVector& Position, const FQuat& Rotation)
+{
+        FBoneOffset& Bone = Bones[BoneIndex];
+
+        // The last output already contains the remaining offset, so the new offset continues from it and keeps its velocity
+        Bone.Position = PrevPositions[BoneIndex] - Position;
+        FQuat PrevRotation = PrevRotations[BoneIndex];
+        PrevRotation = (PrevRotation | Rotation) > 0 ? PrevRotation : PrevRotation * -1.0f;
+        Bone.Rotation = UFeatureComputation::QuatToScaledAngleAxis(PrevRotation * Rotation.Inverse());
+
+        if (!Bone.bActive)
+        {
+                Bone.Velocity = FVector::ZeroVector;
+                Bone.AngularVelocity = FVector::ZeroVector;
+                Bone.bActive = true;
+                ActiveBones.Add(BoneIndex);
+        }
+}
+
+void FOffsetInertializer::Update(TArray<FVector>& Positions, TArray<FQuat>& Rotations, const float dt, bool bDiscontinuity)
+{
+        check(Positions.Num() >= Bones.Num() && Rotations.Num() >= Bones.Num());
+
+        if (!bHasState)
+        {
+                bDiscontinuity = false;
+                bHasState = true;
+        }
+        else if (bDiscontinuity)
+        {
+                for (int32 i = 0; i < Bones.Num(); i++)
+                {
+                        CaptureOffset(i, Positions[i], Rotations[i]);
+                }
+        }
+        else if (PositionThreshold > 0.0f || RotationThreshold > 0.0f)
+        {
+                const float SquaredPositionThreshold = PositionThreshold * PositionThreshold;
+                for (int32 i = 0; i < Bones.Num(); i++)
+                {
+                        const bool bPositionJump = PositionThreshold > 0.0f && FVector::DistSquared(Positions[i], PrevGoalPositions[i]) > SquaredPositionThreshold;
+                        const bool bRotationJump = RotationThreshold > 0.0f && Rotations[i].AngularDistance(PrevGoalRotations[i]) > RotationThreshold;
+                        if (bPositionJump || bRotationJump)
+                        {
+                                CaptureOffset(i, Positions[i], Rotations[i]);
+                        }
+                }
+        }
+
+        if (PositionThreshold > 0.0f || RotationThreshold > 0.0f)
+        {
+                PrevGoalPositions = Positions;
+                PrevGoalRotations = Rotations;
+        }
+
+        // Converged characters stop here
+        if (ActiveBones.Num() > 0)
+        {
+                const float y = (6.64f * 0.69314718056f / halfLife) / 2.0f;
+                const float eydt = FMath::Exp(-y * dt);
+                const float SquaredPositionEpsilon = PositionEpsilon * PositionEpsilon;
+                const float SquaredRotationEpsilon = RotationEpsilon * RotationEpsilon;
+
+                for (int32 ActiveIndex = ActiveBones.Num() - 1; ActiveIndex >= 0; ActiveIndex--)
+                {
+                        const int32 BoneIndex = ActiveBones[ActiveIndex];
+                        FBoneOffset& Bone = Bones[BoneIndex];
+
+                        // Critically damped decay towards zero
+                        FVector j1 = Bone.Velocity + Bone.Position * y;
+                        Bone.Position = eydt * (Bone.Position + j1 * dt);
+                        Bone.Velocity = eydt * (Bone.Velocity - j1 * y * dt);
+
+                        j1 = Bone.AngularVelocity + Bone.Rotation * y;
+                        Bone.Rotation = eydt * (Bone.Rotation + j1 * dt);
+                        Bone.AngularVelocity = eydt * (Bone.AngularVelocity - j1 * y * dt);
+
+                        if (Bone.Position.SizeSquared() < SquaredPositionEpsilon && Bone.Rotation.SizeSquared() < SquaredRotationEpsilon &&
+                                Bone.Velocity.SizeSquared() < SquaredPositionEpsilon && Bone.AngularVelocity.SizeSquared() < SquaredRotationEpsilon)
+                        {
+                                Bone = FBoneOffset();
+                                ActiveBones.RemoveAtSwap(ActiveIndex, 1, false);
+                                continue;
+                        }
+
+                        Positions[BoneIndex] += Bone.Position;
+                        Rotations[BoneIndex] = UFeatureComputation::QuatFromScaledAngleAxis(Bone.Rotation) * Rotations[BoneIndex];
+                        Rotations[BoneIndex].Normalize();
+                }
+        }
+
+        PrevPositions = Positions;
+        PrevRotations = Rotations;
+}
\ No newline at end of file
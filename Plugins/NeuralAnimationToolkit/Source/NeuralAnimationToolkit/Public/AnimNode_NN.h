@@ -11,10 +11,53 @@
 #include "NNERuntimeCPU.h"
 #include "NNEModelData.h"
 #include "ModelInstance.h"
+#include "ModelRegistry.h"
 #include "Features.h"
 #include "Springs.h"
+#include "SavGolFilter.h"
+#include "InferenceExecutor.h"
+#include "InferenceCache.h"
+#include "CrowdInference.h"
 #include "AnimNode_NN.generated.h"
 
+UENUM(BlueprintType) // Determines how the model output is smoothed before it is applied to the pose
+enum class EInertialisationMode : uint8
+{
+	Spring    UMETA(DisplayName = "Spring"), // Every bone is damped towards the model output every frame
+	Offset    UMETA(DisplayName = "Offset"), // Offsets are captured on discontinuities and decayed, converged bones are skipped
+	SavitzkyGolay    UMETA(DisplayName = "Savitzky-Golay"), // Each new result is smoothed by a polynomial fit over the last results, also smooths the velocities
+};
+
+// Output bone pose of a single inference result together with its velocities
+// Evaluating it at a later time integrates the velocities forward, which keeps the pose moving between inference results
+struct FPoseExtrapolation
+{
+	TArray<FVector> Positions;
+	TArray<FQuat> Rotations;
+	TArray<FVector> Velocities;
+	TArray<FVector> AngularVelocities;
+
+	void Init(int32 NumBones);
+	void Evaluate(float Time, TArray<FVector>& OutPositions, TArray<FQuat>& OutRotations) const;
+};
+
+// Cheaper model of a model LOD chain, trained on the same feature set as the node's ModelData
+USTRUCT(BlueprintType)
+struct NEURALANIMATIONTOOLKIT_API FModelLOD
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = Settings)
+	TObjectPtr<UNNEModelData> ModelData;
+
+	// Anim LOD level from which on this model is used
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (ClampMin = 0))
+	int32 MinLODLevel = 1;
+
+	// Output bones of the feature set this model outputs, in feature set order. Empty means all of them, the other bones keep the source pose
+	UPROPERTY(EditAnywhere, Category = Settings)
+	TArray<FName> OutputBones;
+};
 
 USTRUCT(BlueprintInternalUseOnly)
 struct NEURALANIMATIONTOOLKIT_API FAnimNode_NN : public FAnimNode_Base
@@ -30,18 +73,124 @@ struct NEURALANIMATIONTOOLKIT_API FAnimNode_NN : public FAnimNode_Base
 	UPROPERTY(EditAnywhere, Category = Settings)
 	TObjectPtr<UNNEModelData> ModelData;
 
+	// Progressively cheaper models for higher anim LOD levels, ModelData is used below the MinLODLevel of the first one
+	UPROPERTY(EditAnywhere, Category = Settings)
+	TArray<FModelLOD> ModelLODs;
+
+	// Picks the model LOD directly instead of from the anim LOD level, e.g. from a significance manager. 0 is ModelData, -1 uses the anim LOD level
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (PinHiddenByDefault, ClampMin = -1))
+	int32 ModelLODOverride = -1;
+
+	// Time over which output bones blend between the model output and the source pose when a model LOD switch adds or removes them
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (ClampMin = 0))
+	float ModelLODBlendTime = 0.2f;
+
 	UPROPERTY(EditAnywhere, Category = Settings, meta = (PinShownByDefault))
 	bool isRunning;
 
 	UPROPERTY(EditAnywhere, Category = Settings, meta = (PinShownByDefault))
 	bool isAsync = false;
 
+	// Computes the features from the previous frame's source pose and starts the inference in Update, the result is collected in Evaluate
+	// Hides the inference time behind the rest of the graph, only use it if the features do not need the current source pose. Overrides isAsync
+	UPROPERTY(EditAnywhere, Category = Settings)
+	bool isPipelined = false;
+
+	// Number of inferences per second, 0 runs the model every frame
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (ClampMin = 0))
+	float InferenceRate = 0.0f;
+
+	// Steps the model at a fixed rate instead of once per evaluation, usually the sample rate of the training clips (NumberOfSampledKeys / PlayLength)
+	// Runs the steps that are due, or none, and interpolates the pose between the last two steps. 0 runs the model once per evaluation
+	// The model runs at most once per evaluation unless it has StateTensors, a recurrent model runs every due step so its state advances at the fixed rate
+	// Overrides isAsync, isPipelined, InferenceRate and isExtrapolated
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (ClampMin = 0))
+	float FixedStepRate = 0.0f;
+
+	// Most steps run in one evaluation, the rest are dropped after a hitch
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "FixedStepRate > 0", ClampMin = 1))
+	int32 MaxSubSteps = 4;
+
+	// Reuses the output of an earlier inference when the features match up to MemoizationTolerance, e.g. for idle and looping characters
+	// Not used together with StateTensors, the recurrent state makes the output differ for the same features
+	UPROPERTY(EditAnywhere, Category = Settings)
+	bool isMemoized = false;
+
+	// Step every feature value is rounded to before the features are compared, 0 only reuses outputs for exactly the same features
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isMemoized", ClampMin = 0))
+	float MemoizationTolerance = 0.001f;
+
+	// Number of outputs kept, the oldest one is replaced first
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isMemoized", ClampMin = 1))
+	int32 MemoizationCapacity = 16;
+
+	// Shares the kept outputs with every node running the same model, so a crowd of idle characters runs the model once
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isMemoized"))
+	bool isMemoizationShared = false;
+
+	// Clusters the features of every character running this model each frame and runs the model once per cluster
+	// Each member applies the shared output through its own inertialisation. Not used together with StateTensors, overrides isAsync and isPipelined
+	UPROPERTY(EditAnywhere, Category = Settings)
+	bool isCrowdShared = false;
+
+	// Step every feature value is rounded to when clustering, characters whose rounded features match share one inference
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isCrowdShared", ClampMin = 0))
+	float CrowdClusterSize = 0.05f;
+
+	// Recurrent state of the model, each output is fed back into its input on the next inference without leaving the model instance
+	UPROPERTY(EditAnywhere, Category = Settings)
+	TArray<FModelStateTensor> StateTensors;
+
+	// While true the recurrent state is reset before every inference, e.g. pulse it on teleports and pose snaps
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (PinHiddenByDefault))
+	bool isStateReset = false;
+
+	// Moves the output bones with their velocities between inference results instead of holding the last result
+	UPROPERTY(EditAnywhere, Category = Settings)
+	bool isExtrapolated = false;
+
+	// Time over which the extrapolated pose blends into a new inference result
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isExtrapolated", ClampMin = 0))
+	float ExtrapolationBlendTime = 0.1f;
+
+	// Extrapolation stops after this long without a new result
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isExtrapolated", ClampMin = 0))
+	float MaxExtrapolationTime = 0.25f;
+
 	UPROPERTY(EditAnywhere, Category = Settings)
 	bool isInertialised = false;
 
 	UPROPERTY(EditAnywhere, Category = Settings)
 	float halfLife = 0.5f;
 
+	// Runs every float of the model output through a tracking spring before it is turned into bone transforms
+	UPROPERTY(EditAnywhere, Category = Settings)
+	bool isOutputSmoothed = false;
+
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isOutputSmoothed"))
+	FTrackingSpringBank OutputSmoothing;
+
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised"))
+	EInertialisationMode InertialisationMode = EInertialisationMode::Spring;
+
+	// Offset mode only, output jumps larger than these are inertialised even without a model change or new async result, 0 disables the check
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised && InertialisationMode == EInertialisationMode::Offset"))
+	float DiscontinuityPositionThreshold = 0.0f;
+
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised && InertialisationMode == EInertialisationMode::Offset"))
+	float DiscontinuityRotationThreshold = 0.0f;
+
+	// Savitzky-Golay mode only, number of results the polynomial is fitted over
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised && InertialisationMode == EInertialisationMode::SavitzkyGolay", ClampMin = 2))
+	int32 SavGolWindowLength = 7;
+
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised && InertialisationMode == EInertialisationMode::SavitzkyGolay", ClampMin = 0))
+	int32 SavGolPolyOrder = 2;
+
+	// Number of results the smoothed output lags behind, 0 evaluates the fit at the newest result
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "isInertialised && InertialisationMode == EInertialisationMode::SavitzkyGolay", ClampMin = 0))
+	int32 SavGolLatency = 0;
+
 	FAnimNode_NN();
 
 public:
@@ -53,19 +202,132 @@ public:
 	virtual void GatherDebugData(FNodeDebugData& DebugData) override;
 	// End of FAnimNode_Base interface
 
+	// Zeros the recurrent state before the next inference
+	void ResetModelState();
+
+	// Inferences skipped and run since the memoization cache was created, counted over all sharing nodes if it is shared
+	int64 GetMemoizationHits() const;
+	int64 GetMemoizationMisses() const;
+
 private:
 	TSharedPtr<FModelInstance> ModelInstance;
 	bool isModelInitialized = false;
+	const UNNEModelData* InitializedModelData = nullptr;
+
+	// Model instance being created in the background for the last requested model data
+	TSharedFuture<TSharedPtr<FModelInstance>> PendingModelInstance;
+	const UNNEModelData* PendingModelData = nullptr;
+
+	// Model LOD of the current and the requested model, 0 is ModelData
+	int32 ActiveModelLOD = 0;
+	int32 PendingModelLOD = 0;
+
+	// Output bones the current model outputs, and how much each output bone overrides the source pose
+	TArray<int32> ActiveOutputBones;
+	TBitArray<> OutputBoneMask;
+	TArray<float> OutputBoneWeights;
+	bool bHasLODResult = false;
+
+	// Model input each feature of the feature set is written to, and views of the input buffers of the current instance
+	TArray<int32> FeatureInputIndices;
+	TArray<TArrayView<float>> InputTensorViews;
+	bool bStateResetPending = false;
+
+	// Memoized outputs, and the key of the inference that has to add its output after a miss
+	TSharedPtr<FInferenceCache> InferenceCache;
+	uint64 InferenceCacheKey = 0;
+	bool bInferenceCacheKeyPending = false;
+	TArray<float> MemoizedOutput;
+
+	// Crowd this node clusters with, and the cluster it was in on the last inference
+	TSharedPtr<FCrowdInference> CrowdInference;
+	uint64 CrowdClusterKey = 0;
+
+	// Async mode only, the inference launched in an earlier evaluation, its result is collected once the future is ready
+	TSharedFuture<int32> AsyncInference;
+
+	// Pipelined mode only, source pose of the last evaluation and the inference launched from it
+	FCompactHeapPose PipelinePose;
+	bool bHasPipelinePose = false;
+	TSharedFuture<int32> PipelinedInference;
+	bool bPipelinedResultPending = false;
+	bool bPipelinedResultMemoized = false;
+	bool bHasOutputPose = false;
+	bool bOutputDiscontinuity = false;
 	bool isBonesRefInitialized = false;
 	TArray<FVector> BonePositions;
 	TArray<FQuat> BoneRotations;
 	TArray<FVector> BoneVelocities;
 	TArray<FVector> BoneAngularVelocities;
-	TArray<FTransformSpring> Inertializers;
 
+	// Last inference result and the extrapolated pose it blends away from
+	FPoseExtrapolation Extrapolation;
+	FPoseExtrapolation BlendSource;
+	float TimeSinceResult = 0.0f;
+	TArray<FVector> BlendSourcePositions;
+	TArray<FQuat> BlendSourceRotations;
+
+	// Fixed step mode only, time not stepped yet, time since the features were last taken and the result of the step before the last one
+	float StepAccumulator = 0.0f;
+	float StepSampleTime = 0.0f;
+	float StepAlpha = 1.0f;
+	TArray<FVector> StepPreviousPositions;
+	TArray<FQuat> StepPreviousRotations;
+
+	// Compact pose index of every output bone, cached for the bone container with the serial number
+	TArray<FCompactPoseBoneIndex> OutputBoneIndices;
+	uint16 OutputBonesSerialNumber = 0;
+
+	// Component space write-back, the output bones and their ancestors in compact pose order, so parents come first
+	// For each the slot of its parent and the output bone it is, or INDEX_NONE
+	// During the write-back its new component space transform and whether that differs from the source pose
+	TArray<FCompactPoseBoneIndex> WriteBackBones;
+	TArray<int32> WriteBackParents;
+	TArray<int32> WriteBackOutputBones;
+	TArray<FTransform> WriteBackTransforms;
+	TBitArray<> WriteBackMoved;
+
+	// Source pose of the evaluation in component space, shared by the feature extraction and the output write-back
+	// Kept between evaluations so its allocations are reused
+	FCompactHeapPose ComponentSpaceSourcePose;
+	FCSPose<FCompactHeapPose> ComponentSpacePose;
+	bool bIsComponentSpacePoseValid = false;
+
+	// Pose written to the output bones, the model output after inertialisation
+	TArray<FVector> OutputPositions;
+	TArray<FQuat> OutputRotations;
+	FTransformSpringBank Inertializer;
+	FOffsetInertializer OffsetInertializer;
+	FStreamingSavGolFilter ResultFilter;
+	TArray<float> ResultFilterChannels;
+	TArray<float> ResultFilterDerivatives;
+
+	// Copy of the model output the output smoothing works on, only used with isOutputSmoothed
+	TArray<float> SmoothedOutput;
+
+	void UpdateOutputPose(const float DeltaTime, bool bNewResult);
+	void FilterResult(const float ResultDeltaTime);
+	void CacheOutputBones(const FBoneContainer& BoneContainer);
 	void SetLocalBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer);
 	void SetComponentSpaceBoneTransforms(FPoseContext& Output, const FBoneContainer& BoneContainer);
 	void InitializeModel(TObjectPtr<UNNEModelData> modelData);
-	int EvaluateModel(TArray<float>& InputData, const float DeltaTime);
-	int ProcessOutput(const float DeltaTime);
+	void RequestModelLOD(const FAnimationBaseContext& Context);
+	int32 SelectModelLOD(const int32 LODLevel) const;
+	void BindOutputBones(bool bBlend);
+	void UpdateOutputBoneWeights(const float DeltaTime);
+	void UpdatePendingModel();
+	void BindFeatureInputs();
+	void BindInferenceCache();
+	bool FindMemoizedOutput();
+	void MemoizeOutput(TConstArrayView<float> OutputData);
+	void BindCrowdInference();
+	bool IsInferenceDue(const float Time) const;
+	bool IsAsyncActive() const;
+	bool IsPipelinedActive() const;
+	int StepModel(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& Pose, const float DeltaTime);
+	FCSPose<FCompactHeapPose>& GetComponentSpacePose(const FCompactPose& Pose);
+	bool PrepareInference(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& Pose, const float DeltaTime);
+	int EvaluateModel(const float DeltaTime);
+	int EvaluateCrowdModel(const float DeltaTime);
+	int ProcessOutput(const float DeltaTime, TConstArrayView<float> OutputData);
 };
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "Misc/FileHelper.h"
 #include "Serialization/BufferArchive.h"
 #include "Misc/Paths.h"
+#include "BinaryBuilder.generated.h"
 
 // Simple binary parser
 // The format of the binary file is as follows:
@@ -15,10 +17,130 @@
 // The data array is an array of floats that represent the data passed down to the function
 
 // The binary can be then read in by sample python script (ExternalTools/BinaryReader.py) to then be used in the training of the neural network
+//
+// Large arrays can instead be written as a set of shards described by a json manifest
+// Each shard holds a fixed number of rows (the first dimension) stored in the chosen encoding and compressed on its own, so shards can be read in parallel
+// The manifest stores the dimensions, encoding, compression and the file, first row, row count and sizes of each shard
+// Quantized encodings store the per-column scale and offset of every shard with the shard, so shards can be written before the rest of the data is known
+
+UENUM(BlueprintType) // Determines how the values of a sharded binary are stored
+enum class EBinaryEncoding : uint8
+{
+    Float32        UMETA(DisplayName = "Float32"),
+    Float16        UMETA(DisplayName = "Float16"),
+    Quantized16    UMETA(DisplayName = "Quantized 16 bit"), // Each column is scaled between its min and max and stored as uint16
+    Quantized8     UMETA(DisplayName = "Quantized 8 bit"), // Each column is scaled between its min and max and stored as uint8
+};
+
+UENUM(BlueprintType) // Compression applied to each shard of a sharded binary
+enum class EBinaryCompression : uint8
+{
+    None    UMETA(DisplayName = "None"),
+    LZ4     UMETA(DisplayName = "LZ4"),
+    Zlib    UMETA(DisplayName = "Zlib"),
+    Oodle   UMETA(DisplayName = "Oodle"),
+};
+
+struct FBinaryShard
+{
+    FString FileName;
+    int32 FirstRow = 0;
+    int32 NumRows = 0;
+    int64 Size = 0;
+    int64 RawSize = 0;
+
+    // Column ranges of quantized encodings
+    TArray<float> Scale;
+    TArray<float> Offset;
+};
+
+struct FBinaryShardManifest
+{
+    FString Directory;
+    TArray<int32> Dimensions;
+    int32 RowSize = 0;
+    EBinaryEncoding Encoding = EBinaryEncoding::Float32;
+    EBinaryCompression Compression = EBinaryCompression::None;
+
+    // Only set by manifests of version 1, which quantized all shards with the same column ranges
+    TArray<float> Scale;
+    TArray<float> Offset;
+
+    TArray<FBinaryShard> Shards;
+};
+
+// Writes a binary file or a set of shards row by row, so arrays larger than memory can be written while they are produced
+// The first dimension is the number of appended rows and is only written once the writer is finished
+// Every file is written with TempSuffix appended to its name, the temporary files are deleted again if the writer is destroyed before it is finished
+class NEURALANIMATIONTOOLKIT_API FBinaryFileWriter
+{
+public:
+    // Writes a single file in the format of UBinaryBuilder::SaveToBinaryFile
+    FBinaryFileWriter(const FString& InFilePath, const TArray<int32>& InRowDimensions, const FString& InTempSuffix);
+
+    // Writes <FilePath>.<index>.bin shards of RowsPerShard rows each, which are encoded and compressed on the thread pool, and <FilePath>.manifest.json
+    FBinaryFileWriter(const FString& InFilePath, const TArray<int32>& InRowDimensions, int32 InRowsPerShard, EBinaryEncoding InEncoding, EBinaryCompression InCompression, const FString& InTempSuffix);
+
+    ~FBinaryFileWriter();
+
+    // Data must hold exactly NumRows rows
+    bool Append(TConstArrayView<float> Data, int32 NumRows);
+
+    // Writes the remaining rows and the dimensions, OutFilePaths receives the final paths of all written files
+    bool Finish(TArray<FString>& OutFilePaths);
+
+    int64 GetNumRows() const { return NumRows; }
+
+private:
+    void FlushShard();
+
+    // Waits for the oldest shards until no more than MaxPendingShards are being written
+    void CollectShards(int32 MaxPendingShards);
+
+    bool WriteManifest();
+
+    FString FilePath;
+    TArray<int32> RowDimensions;
+    FString TempSuffix;
+    int32 RowSize = 1;
+    int64 NumRows = 0;
+    bool bFailed = false;
+    bool bFinished = false;
+
+    TUniquePtr<FArchive> FileWriter;
+
+    bool bSharded = false;
+    int32 RowsPerShard = 0;
+    EBinaryEncoding Encoding = EBinaryEncoding::Float32;
+    EBinaryCompression Compression = EBinaryCompression::None;
+    TArray<float> PendingRows;
+    int32 NumShards = 0;
+    TArray<TFuture<TOptional<FBinaryShard>>> PendingShards;
+    TArray<FBinaryShard> Shards;
+    TArray<FString> TempFilePaths;
+};
+
 class NEURALANIMATIONTOOLKIT_API UBinaryBuilder
 {
 public:
     static bool SaveToBinaryFile(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<float>& Data);
     static bool SaveToBinaryFile(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<int32>& Data);
     static TArray<float> LoadFromBinaryFile(const FString& FilePath);
+
+    // Relative paths passed to SaveToBinaryFile are resolved against the project directory
+    static FString GetAbsolutePath(const FString& FilePath);
+
+    // Moves a finished temporary file over its final location, used so that an interrupted export never leaves partial files behind
+    static bool CommitFile(const FString& TempFilePath, const FString& FilePath);
+
+    // Writes Data as <FilePath>.manifest.json and <FilePath>.<index>.bin shards of RowsPerShard rows each
+    // Every file is written with TempSuffix appended to its name, OutFilePaths receives the final paths of all written files
+    static bool SaveToShardedBinaryFiles(const FString& FilePath, const TArray<int32>& Dimensions, const TArray<float>& Data, int32 RowsPerShard,
+        EBinaryEncoding Encoding, EBinaryCompression Compression, const FString& TempSuffix, TArray<FString>& OutFilePaths);
+
+    // Streaming reader for sharded binaries, the manifest is loaded once and each shard can then be decoded independently from any thread
+    static bool LoadShardManifest(const FString& ManifestPath, FBinaryShardManifest& OutManifest);
+    static bool LoadShard(const FBinaryShardManifest& Manifest, int32 ShardIndex, TArray<float>& OutData);
+
+    static FName GetCompressionFormat(EBinaryCompression Compression);
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "NNEModelData.h"
+#include "ModelInstance.h"
+
+// Groups the characters running the same model by their features each frame and runs the model once per group
+// The features are rounded to the cluster size and hashed, characters with the same hash in a frame form a cluster
+// The first character to join a cluster is its representative, its model instance runs on the inference threads and every member gets the output
+class NEURALANIMATIONTOOLKIT_API FCrowdInference
+{
+public:
+	// Crowd of every node running the model with the same cluster size, created on first use
+	static TSharedRef<FCrowdInference> Get(const UNNEModelData* ModelData, float InClusterSize);
+
+	explicit FCrowdInference(float InClusterSize);
+
+	uint64 ComputeClusterKey(TConstArrayView<TArrayView<float>> Inputs) const;
+
+	// Returns the output of the cluster in the current frame, starting the inference on the model instance if the cluster is new
+	// The instance must not be used until the future is ready. The output is empty if the inference failed
+	TSharedFuture<TArray<float>> Join(uint64 ClusterKey, const TSharedPtr<FModelInstance>& ModelInstance);
+
+	// Clusters and characters in the last completed frame
+	int32 NumClusters() const;
+	int32 NumMembers() const;
+
+private:
+	float ClusterSize = 0.0f;
+
+	mutable FCriticalSection ClustersCriticalSection;
+	TMap<uint64, TSharedFuture<TArray<float>>> Clusters;
+	uint64 ClusterFrame = 0;
+	int32 FrameMembers = 0;
+	int32 LastFrameClusters = 0;
+	int32 LastFrameMembers = 0;
+};
@@ -5,6 +5,7 @@
 #include "Interfaces/Interface_BoneReferenceSkeletonProvider.h"
 #include "UObject/Interface.h"
 #include "FeatureComputation.h"
+#include "BinaryBuilder.h"
 #include "Features.generated.h"
 
 struct FBoneReference;
@@ -61,13 +62,30 @@ public:
 	// Each feature should support its own initialisation and computation both offline when extracting the dataset, and realtime when running the neural network
 	virtual	void InitialiseOffline(const FReferenceSkeleton& RefSkeleton) {};
 	virtual	void InitialiseRealTime(const FBoneContainer& BoneContainer)  {};
-	virtual	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactPose> InPose, float DeltaTime) { return TArray<float>(); };
+	virtual	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime) { return TArray<float>(); };
+	// Writes the realtime feature straight into OutData and returns the number of floats written, INDEX_NONE if it does not fit
+	// Falls back to ComputeRealTime, features override it to skip the temporary array
+	virtual	int32 WriteRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime, TArrayView<float> OutData)
+	{
+		const TArray<float> Data = ComputeRealTime(BoneContainer, InPose, DeltaTime);
+		if (Data.Num() > OutData.Num())
+		{
+			return INDEX_NONE;
+		}
+		FMemory::Memcpy(OutData.GetData(), Data.GetData(), Data.Num() * sizeof(float));
+		return Data.Num();
+	}
 	virtual	TArray<float> ComputeOffline(const TArray<TArray<FTransform>>& BoneTransforms, float DeltaTime, int FrameIndex) { return TArray<float>(); };
 	virtual	int32 GetFeatureSize() const { return 0; } // Get the array size of the feature
 
 	// Feature space to select between component space and local space
 	UPROPERTY(EditAnywhere, meta = (Bitmask, BitmaskEnum = EFeatureBoneTransformFlags), Category = "Feature")
 	int32 FeatureSpace = int32(EFeatureBoneTransformFlags::Local);
+
+	// Name of the model input this feature is written to, None writes to the first input
+	// Features sharing an input are written one after another in the order of the feature set
+	UPROPERTY(EditAnywhere, Category = "Feature")
+	FName InputTensor;
 };
 // Below are sample features showing how to use the interface to extract bone and trajectory related information
 // When added to the feature set the interface funcitons are then used to compute the feature vetors necessary for the neural network
@@ -97,12 +115,20 @@ public:
 		BoneReference.Initialize(BoneContainer);
 		BoneIndex = int32(BoneReference.GetCompactPoseIndex(BoneContainer));
 	};
-	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactPose> InPose, float DeltaTime) override
+	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime) override
 	{
 		TArray<float> Data;
+		Data.SetNumUninitialized(GetFeatureSize());
+		Data.SetNum(FMath::Max(WriteRealTime(BoneContainer, InPose, DeltaTime, Data), 0));
+		return Data;
+	}
 
-		if (BoneIndex == INDEX_NONE) return Data;
+	int32 WriteRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime, TArrayView<float> OutData) override
+	{
+		if (BoneIndex == INDEX_NONE) return 0;
+		if (OutData.Num() < GetFeatureSize()) return INDEX_NONE;
 
+		int32 Num = 0;
 		bool isLocal = static_cast<uint8>(FeatureSpace) & static_cast<uint8>(EFeatureBoneTransformFlags::Local);
 
 		FTransform BoneTransform = isLocal ? InPose.GetLocalSpaceTransform(FCompactPoseBoneIndex(BoneIndex)) : InPose.GetComponentSpaceTransform(FCompactPoseBoneIndex(BoneIndex));
@@ -113,9 +139,9 @@ public:
 		if (static_cast<uint8>(Properties) & static_cast<uint8>(EFeatureBoneFlags::Position))
 		{
 			
-			Data.Add(position.X);
-			Data.Add(position.Y);
-			Data.Add(position.Z);
+			OutData[Num++] = position.X;
+			OutData[Num++] = position.Y;
+			OutData[Num++] = position.Z;
 		}
 
 		if (static_cast<uint8>(Properties) & static_cast<uint8>(EFeatureBoneFlags::Rotation))
@@ -125,22 +151,22 @@ public:
 			{
 				case ERotationFormat::Quaternion:
 				{
-					Data.Add(rotation.X);
-					Data.Add(rotation.Y);
-					Data.Add(rotation.Z);
-					Data.Add(rotation.W);
+					OutData[Num++] = rotation.X;
+					OutData[Num++] = rotation.Y;
+					OutData[Num++] = rotation.Z;
+					OutData[Num++] = rotation.W;
 					break;
 				}
 				case ERotationFormat::XFormXY:
 				{
 					FVector x, y;
 					UFeatureComputation::GetXformXYFromQuat(rotation, x, y);
-					Data.Add(x.X);
-					Data.Add(x.Y);
-					Data.Add(x.Z);
-					Data.Add(y.X);
-					Data.Add(y.Y);
-					Data.Add(y.Z);
+					OutData[Num++] = x.X;
+					OutData[Num++] = x.Y;
+					OutData[Num++] = x.Z;
+					OutData[Num++] = y.X;
+					OutData[Num++] = y.Y;
+					OutData[Num++] = y.Z;
 					break;
 				}
 			}
@@ -149,23 +175,23 @@ public:
 		if (static_cast<uint8>(Properties) & static_cast<uint8>(EFeatureBoneFlags::Velocity)) {
 			FVector prevPosition = CachedBoneTransform.GetLocation();
 			FVector velocity = position - prevPosition / DeltaTime;
-			Data.Add(velocity.X);
-			Data.Add(velocity.Y);
-			Data.Add(velocity.Z);
+			OutData[Num++] = velocity.X;
+			OutData[Num++] = velocity.Y;
+			OutData[Num++] = velocity.Z;
 		}
 
 		if (static_cast<uint8>(Properties) & static_cast<uint8>(EFeatureBoneFlags::AngularVelocity)) {
 			FVector prevRotation = UFeatureComputation::QuatToScaledAngleAxis(CachedBoneTransform.GetRotation());
 			FVector currentRotation = UFeatureComputation::QuatToScaledAngleAxis(rotation);
 			FVector angularVelocity = (currentRotation - prevRotation) / DeltaTime;
-			Data.Add(angularVelocity.X);
-			Data.Add(angularVelocity.Y);
-			Data.Add(angularVelocity.Z);
+			OutData[Num++] = angularVelocity.X;
+			OutData[Num++] = angularVelocity.Y;
+			OutData[Num++] = angularVelocity.Z;
 		}
 
 		CachedBoneTransform = BoneTransform;
 
-		return Data;
+		return Num;
 	}
 
 	TArray<float> ComputeOffline(const TArray<TArray<FTransform>>& BoneTransforms, float DeltaTime, int FrameIndex) override
@@ -326,9 +352,20 @@ public:
 		DirectionBoneIndex = int32(DirectionBoneReference.GetCompactPoseIndex(BoneContainer));
 	}
 
-	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactPose> InPose, float DeltaTime) override 
+	TArray<float> ComputeRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime) override 
 	{ 
-		TArray<float> Data = TArray<float>();
+		TArray<float> Data;
+		Data.SetNumUninitialized(GetRealTimeSize());
+		Data.SetNum(FMath::Max(WriteRealTime(BoneContainer, InPose, DeltaTime, Data), 0));
+		return Data;
+	}
+
+	int32 WriteRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& InPose, float DeltaTime, TArrayView<float> OutData) override
+	{
+		if (OutData.Num() < GetRealTimeSize()) return INDEX_NONE;
+
+		int32 Num = 0;
+		const bool bIsThreeDimensional = static_cast<uint8>(Dimension) & static_cast<uint8>(EFeatureTrajectoryDimensionFlags::Three);
 		if (static_cast<uint8>(Property) & static_cast<uint8>(EFeatureTrajectoryFlags::Position))
 		{
 			FVector position;
@@ -336,11 +373,11 @@ public:
 			{
 				position = InPose.GetComponentSpaceTransform(FCompactPoseBoneIndex(PositionBoneIndex)).GetLocation();
 			}
-			Data.Add(position.X);
-			Data.Add(position.Y);
-			if (static_cast<uint8>(Dimension) & static_cast<uint8>(EFeatureTrajectoryDimensionFlags::Three))
+			OutData[Num++] = position.X;
+			OutData[Num++] = position.Y;
+			if (bIsThreeDimensional)
 			{
-				Data.Add(position.Z);
+				OutData[Num++] = position.Z;
 			}
 		}
 		if (static_cast<uint8>(Property) & static_cast<uint8>(EFeatureTrajectoryFlags::Direction))
@@ -352,15 +389,15 @@ public:
 			}
 
 			FVector direction = rotation.RotateVector(FVector(1.0f, 0.0f, 0.0f));
-			Data.Add(direction.X);
-			Data.Add(direction.Y);
-			if (static_cast<uint8>(Dimension) & static_cast<uint8>(EFeatureTrajectoryDimensionFlags::Three))
+			OutData[Num++] = direction.X;
+			OutData[Num++] = direction.Y;
+			if (bIsThreeDimensional)
 			{
-				Data.Add(direction.Z);
+				OutData[Num++] = direction.Z;
 			}
 
 		}
-		return Data;
+		return Num;
 	}
 
 	TArray<float> ComputeOffline(const TArray<TArray<FTransform>>& BoneTransforms, float DeltaTime, int FrameIndex) override 
@@ -425,10 +462,49 @@ public:
 	}
 
 private:
+	// The realtime feature only holds the current sample
+	int32 GetRealTimeSize() const
+	{
+		const int32 SampleSize = static_cast<uint8>(Dimension) & static_cast<uint8>(EFeatureTrajectoryDimensionFlags::Three) ? 3 : 2;
+		int32 Size = 0;
+		if (static_cast<uint8>(Property) & static_cast<uint8>(EFeatureTrajectoryFlags::Position)) Size += SampleSize;
+		if (static_cast<uint8>(Property) & static_cast<uint8>(EFeatureTrajectoryFlags::Direction)) Size += SampleSize;
+		return Size;
+	}
+
 	int32 PositionBoneIndex = INDEX_NONE;
 	int32 DirectionBoneIndex = INDEX_NONE;
 };
 
+// Controls how the exporter lays out dataset.bin and features.bin on disk
+USTRUCT(BlueprintType)
+struct NEURALANIMATIONTOOLKIT_API FDatasetExportOptions
+{
+	GENERATED_BODY()
+
+	// Write fixed size shards with a manifest instead of a single monolithic file
+	UPROPERTY(EditAnywhere, Category = "Export")
+	bool bSharded = false;
+
+	UPROPERTY(EditAnywhere, Category = "Export", meta = (EditCondition = "bSharded", ClampMin = 1))
+	int32 FramesPerShard = 65536;
+
+	UPROPERTY(EditAnywhere, Category = "Export", meta = (EditCondition = "bSharded"))
+	EBinaryEncoding Encoding = EBinaryEncoding::Float32;
+
+	UPROPERTY(EditAnywhere, Category = "Export", meta = (EditCondition = "bSharded"))
+	EBinaryCompression Compression = EBinaryCompression::LZ4;
+
+	// Write windows.bin with the start frame of every window of HistoryLength + FutureLength frames that does not cross a sequence boundary
+	UPROPERTY(EditAnywhere, Category = "Export")
+	bool bExportWindows = false;
+
+	UPROPERTY(EditAnywhere, Category = "Export", meta = (EditCondition = "bExportWindows", ClampMin = 0))
+	int32 HistoryLength = 1;
+
+	UPROPERTY(EditAnywhere, Category = "Export", meta = (EditCondition = "bExportWindows", ClampMin = 0))
+	int32 FutureLength = 1;
+};
 
 // Feature set data asset to store all features and interact with toolkit widgets and the neural network animNode
 // Offline, this class is used to generate the dataset and feature files that can be then passed to the python side of the project using a parser located in ExternalTools folder.
@@ -457,6 +533,23 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Dataset")
 	bool bGetVelocitiesFromModelOutput = false;
 
+	// Smooths the local bone transforms of every exported sequence with a Savitzky-Golay filter to remove mocap jitter
+	UPROPERTY(EditAnywhere, Category = "Dataset")
+	bool bDenoiseWithSavGol = false;
+
+	// Exported velocities come from the derivative of a Savitzky-Golay fit instead of central differences
+	UPROPERTY(EditAnywhere, Category = "Dataset")
+	bool bSavGolVelocities = false;
+
+	UPROPERTY(EditAnywhere, Category = "Dataset", meta = (EditCondition = "bDenoiseWithSavGol || bSavGolVelocities", ClampMin = 3))
+	int32 SavGolWindowLength = 7;
+
+	UPROPERTY(EditAnywhere, Category = "Dataset", meta = (EditCondition = "bDenoiseWithSavGol || bSavGolVelocities", ClampMin = 1))
+	int32 SavGolPolyOrder = 3;
+
+	UPROPERTY(EditAnywhere, Category = "Export")
+	FDatasetExportOptions ExportOptions;
+
 	// IBoneReferenceSkeletonProvider
 	USkeleton* GetSkeleton(bool& bInvalidSkeletonIsError, const IPropertyHandle* PropertyHandle) override
 	{
@@ -515,17 +608,66 @@ public:
 		return FeatureVector;
 	}
 
-	TArray<float> ComputeFeaturesRealTime(const FBoneContainer& BoneContainer, FPoseContext& Output, float DeltaTime) {
-		FCSPose<FCompactPose> CurrentPose;
-		CurrentPose.InitPose(Output.Pose);
-
-		TArray<float> FeatureVector;
+	// Index of the model input every feature is written to, INDEX_NONE if the model has no input with that name
+	TArray<int32> GetFeatureInputIndices(TConstArrayView<FString> InputNames) const
+	{
+		TArray<int32> InputIndices;
 		for (TObjectPtr<UFeature> Feature : Features)
 		{
-			TArray<float> FeatureData = Feature->ComputeRealTime(BoneContainer, CurrentPose, DeltaTime);
-			FeatureVector.Append(FeatureData);
+			if (Feature->InputTensor.IsNone())
+			{
+				InputIndices.Add(0);
+				continue;
+			}
+
+			const int32 InputIndex = InputNames.IndexOfByKey(Feature->InputTensor.ToString());
+			if (InputIndex == INDEX_NONE)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Model has no input named %s"), *Feature->InputTensor.ToString());
+			}
+			InputIndices.Add(InputIndex);
 		}
-		return FeatureVector;
+		return InputIndices;
+	}
+
+	// Writes every feature straight into the model input given by FeatureInputs, see GetFeatureInputIndices
+	// The component space transforms are computed lazily in Pose, so the caller can reuse them afterwards
+	// Fails unless every input the features are written to is filled exactly
+	bool ComputeFeaturesRealTime(const FBoneContainer& BoneContainer, FCSPose<FCompactHeapPose>& Pose, float DeltaTime, TConstArrayView<int32> FeatureInputs, TArrayView<TArrayView<float>> InputTensors) {
+
+		TArray<int32, TInlineAllocator<8>> Offsets;
+		Offsets.SetNumZeroed(InputTensors.Num());
+
+		for (int i = 0; i < Features.Num(); i++)
+		{
+			const int32 InputIndex = FeatureInputs.IsValidIndex(i) ? FeatureInputs[i] : INDEX_NONE;
+			if (!InputTensors.IsValidIndex(InputIndex))
+			{
+				return false;
+			}
+
+			// Each feature writes right behind the previous one of the same input
+			TArrayView<float> Tensor = InputTensors[InputIndex];
+			const int32 NumWritten = Features[i]->WriteRealTime(BoneContainer, Pose, DeltaTime, Tensor.RightChop(Offsets[InputIndex]));
+			if (NumWritten == INDEX_NONE)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Features do not fit into model input %d (%d floats)"), InputIndex, Tensor.Num());
+				return false;
+			}
+
+			Offsets[InputIndex] += NumWritten;
+		}
+
+		// A feature that wrote less than its size, e.g. a bone missing from the mesh, would shift every later feature and leave stale values at the end
+		for (int32 InputIndex = 0; InputIndex < InputTensors.Num(); InputIndex++)
+		{
+			if (FeatureInputs.Contains(InputIndex) && Offsets[InputIndex] != InputTensors[InputIndex].Num())
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Features only fill %d of the %d floats of model input %d"), Offsets[InputIndex], InputTensors[InputIndex].Num(), InputIndex);
+				return false;
+			}
+		}
+		return true;
 	}
 
 	int32 GetFeatureVectorSize() const
@@ -569,6 +711,12 @@ public:
 	}
 
 	int32 GetOutputVectorSize() const
+	{
+		return GetOutputBoneVectorSize() * OutputBones.Num();
+	}
+
+	// Number of output floats per output bone
+	int32 GetOutputBoneVectorSize() const
 	{
 		int32 Size = 0;
 		if (static_cast<uint8>(PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Position))
@@ -594,7 +742,7 @@ public:
 		{
 			Size += 3;
 		}
-		return Size * OutputBones.Num();
+		return Size;
 	}
 
 private:
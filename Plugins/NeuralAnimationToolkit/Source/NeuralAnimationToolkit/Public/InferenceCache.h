@@ -0,0 +1,41 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NNEModelData.h"
+#include <atomic>
+
+// Model outputs keyed by a hash of the model inputs rounded to a tolerance, so near-identical inputs reuse an earlier output
+// Holds at most Capacity outputs, the oldest one is replaced first. Safe to use from several anim workers at once
+class NEURALANIMATIONTOOLKIT_API FInferenceCache
+{
+public:
+	FInferenceCache(float InTolerance, int32 InCapacity);
+
+	// Cache shared by every node running the model with the same tolerance, created on first use
+	static TSharedRef<FInferenceCache> GetShared(const UNNEModelData* ModelData, float InTolerance, int32 InCapacity);
+
+	// Hashes all inputs, each value rounded to a multiple of the tolerance. A tolerance of 0 hashes the exact values
+	static uint64 HashInputs(TConstArrayView<TArrayView<float>> Inputs, float InTolerance);
+	uint64 ComputeKey(TConstArrayView<TArrayView<float>> Inputs) const { return HashInputs(Inputs, Tolerance); }
+
+	// Copies the output stored for the key and counts a hit, or counts a miss
+	bool Find(uint64 Key, TArray<float>& OutOutput);
+	void Add(uint64 Key, TConstArrayView<float> Output);
+
+	float GetTolerance() const { return Tolerance; }
+	int64 NumHits() const { return Hits.load(std::memory_order_relaxed); }
+	int64 NumMisses() const { return Misses.load(std::memory_order_relaxed); }
+
+private:
+	float Tolerance = 0.0f;
+	int32 Capacity = 0;
+
+	mutable FRWLock Lock;
+	TMap<uint64, int32> EntryIndices;
+	TArray<uint64> EntryKeys;
+	TArray<TArray<float>> EntryOutputs;
+	int32 NextEntry = 0;
+
+	std::atomic<int64> Hits = 0;
+	std::atomic<int64> Misses = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/LockFreeList.h"
+#include "HAL/Runnable.h"
+#include <atomic>
+
+class FEvent;
+class FRunnableThread;
+
+struct FInferenceExecutorStats
+{
+	int32 NumThreads = 0;
+	int32 QueueDepth = 0;
+	int32 MaxQueueDepth = 0;
+	uint64 NumExecuted = 0;
+	uint64 NumStolen = 0;
+
+	// Time between submitting a job and an inference thread starting it, in seconds
+	double AverageWaitTime = 0.0;
+	double MaxWaitTime = 0.0;
+
+	FString ToString() const;
+};
+
+// Fixed pool of threads that only run model inferences, so they do not compete with the anim evaluation tasks they overlap
+// Every thread has its own lock-free queue, jobs are spread over the queues round robin and idle threads steal from the others
+// Thread count and core affinity come from the project settings, the pool is created on first use and lives until the module shuts down
+class NEURALANIMATIONTOOLKIT_API FInferenceExecutor
+{
+public:
+	static FInferenceExecutor& Get();
+
+	// Waits for submissions in flight and stops the threads, jobs still queued and any submitted later run on the calling thread
+	static void Shutdown();
+
+	~FInferenceExecutor();
+
+	// Lock-free, can be called from any thread
+	void Submit(TUniqueFunction<void()> Function);
+
+	// Runs the function on an inference thread, the future is fulfilled with its result
+	TFuture<int32> Launch(TUniqueFunction<int32()> Function);
+
+	FInferenceExecutorStats GetStats() const;
+	void ResetStats();
+
+	int32 NumThreads() const { return Workers.Num(); }
+
+private:
+	struct FJob
+	{
+		TUniqueFunction<void()> Function;
+		uint64 SubmitCycles = 0;
+	};
+
+	class FWorker : public FRunnable
+	{
+	public:
+		FWorker(FInferenceExecutor& InExecutor, int32 InIndex);
+		virtual ~FWorker() override;
+
+		// FRunnable interface
+		virtual uint32 Run() override;
+		virtual void Stop() override;
+		// End FRunnable interface
+
+		TLockFreePointerListFIFO<FJob, PLATFORM_CACHE_LINE_SIZE> Queue;
+		FEvent* WakeEvent = nullptr;
+		FRunnableThread* Thread = nullptr;
+		std::atomic<bool> bIsIdle = false;
+		std::atomic<bool> bStopRequested = false;
+
+	private:
+		FInferenceExecutor& Executor;
+		int32 Index = 0;
+	};
+
+	FInferenceExecutor(int32 NumThreads, uint64 AffinityMask);
+
+	void Stop();
+
+	// Runs one job from the worker's own queue or, if that is empty, one stolen from another queue
+	bool ExecuteNext(int32 WorkerIndex);
+	void Execute(FJob* Job, bool bStolen);
+
+	TArray<TUniquePtr<FWorker>> Workers;
+	std::atomic<uint32> NextWorker = 0;
+	std::atomic<int32> NumSubmitting = 0;
+	std::atomic<bool> bIsStopping = false;
+
+	std::atomic<int32> QueueDepth = 0;
+	std::atomic<int32> MaxQueueDepth = 0;
+	std::atomic<uint64> NumExecuted = 0;
+	std::atomic<uint64> NumStolen = 0;
+	std::atomic<uint64> TotalWaitCycles = 0;
+	std::atomic<uint64> MaxWaitCycles = 0;
+};
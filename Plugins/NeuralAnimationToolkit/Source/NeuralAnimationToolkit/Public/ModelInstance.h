@@ -22,30 +22,84 @@ public:
 	//TArray<TArray<float>> Data = TArray<TArray<float>>();
 };
 
+// Recurrent state of a model, the output is fed back into the input on the next run
+USTRUCT(BlueprintType, Category = "Neural Network")
+struct FModelStateTensor
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Network")
+	FString Input;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Network")
+	FString Output;
+};
+
+// Buffer of a single named model input or output, bound to the model once when the instance is created
+struct FModelTensor {
+	FString Name;
+	TArray<int32> Shape;
+	TArray<float> Data;
+};
+
 struct FModelInstance {
 
 	TUniquePtr<UE::NNE::IModelInstanceCPU> ModelInstance;
-	TArray<float> InputData;
-	TArray<float> OutputData;
+
+	// One entry per model input and output in model order, the bindings point straight at their Data
+	TArray<FModelTensor> Inputs;
+	TArray<FModelTensor> Outputs;
 	TArray<UE::NNE::FTensorBindingCPU> InputBindings;
 	TArray<UE::NNE::FTensorBindingCPU> OutputBindings;
 	TArray<UE::NNE::FTensorShape> InputTensorShapes;
 	TArray<UE::NNE::FTensorShape> OutputTensorShapes;
-	bool bIsRunning = false;
-	bool bIsFinished = false;
+
+	struct FStateBinding {
+		int32 Input = INDEX_NONE;
+		int32 Output = INDEX_NONE;
+	};
+	TArray<FStateBinding> States;
 
 	FModelInstance() = default;
 	FModelInstance(const TObjectPtr<UNNEModelData> ModelData, const TWeakInterfacePtr<INNERuntimeCPU> Runtime);
+	FModelInstance(UE::NNE::IModelCPU& Model);
 
-	void SetInputData(TArray<float> Data);
+	// Copies into the first input, for models with a single input
+	void SetInputData(const TArray<float>& Data);
 	void ClearOutputData();
 	void Initialize(const TObjectPtr<UNNEModelData> ModelData, const TWeakInterfacePtr<INNERuntimeCPU> Runtime);
 
-	int RunModel(TArray<float> _InputData);
+	// Creates the instance from an already created model, several instances can share one model
+	void Initialize(UE::NNE::IModelCPU& Model);
+
+	// Takes over an instance that was created earlier, e.g. one recycled from a destroyed node
+	void Initialize(TUniquePtr<UE::NNE::IModelInstanceCPU> InModelInstance);
+	bool IsValid() const;
+
+	// State outputs are fed back into their inputs by swapping the bindings of the two buffers after every run, so the state is never copied
+	// Tensors that are not found or differ in size are skipped, returns false if any was skipped
+	bool BindStates(TConstArrayView<FModelStateTensor> StateTensors);
+
+	// Zeros every state, e.g. after a teleport
+	void ResetStates();
+
+	// State the next run reads
+	TConstArrayView<float> GetStateData(int32 Index) const;
+
+	// Runs the model on whatever has been written to the input tensors
+	int RunModel();
+	int RunModel(const TArray<float>& _InputData);
 	static bool CreateTensor(TArray<int32> Shape, UPARAM(ref) FNeuralNetworkTensor& Tensor);
 
 	int32 NumInputs() const;
 	int32 NumOutputs() const;
+	int32 FindInput(const FString& Name) const;
+	int32 FindOutput(const FString& Name) const;
+	TArrayView<float> GetInputData(int32 Index);
+	// Output of the last run, for state outputs this is the buffer swapped into the state input
+	TConstArrayView<float> GetOutputData(int32 Index) const;
 	TArray<int32> GetInputShape(int32 Index) const;
 	TArray<int32> GetOutputShape(int32 Index) const;
 };
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "UObject/ObjectKey.h"
+#include "NNEModelData.h"
+#include "ModelInstance.h"
+#include "ModelRegistry.generated.h"
+
+class FJsonObject;
+
+// Creates the NNE models and model instances on background threads so no anim worker has to wait for them
+// Models are cached by a hash of their runtime data and the runtime name, so reloaded or duplicated assets reuse the same model
+// Every node gets its own instance, instances of destroyed nodes are kept and handed to the next node instead of creating a new session
+// Instances created ahead of time by Preload are handed out first, so a spawning character can start with a ready model
+// An empty runtime name picks the runtime from the project settings, autotuning it per model if enabled
+class NEURALANIMATIONTOOLKIT_API FModelRegistry
+{
+public:
+	static FModelRegistry& Get();
+
+	// The future is fulfilled with an invalid pointer if the runtime is missing or the model could not be created
+	TFuture<TSharedPtr<FModelInstance>> RequestInstance(UNNEModelData* ModelData, const FString& RuntimeName = FString());
+
+	// Creates the model and NumInstances instances in the background, to be picked up by the next RequestInstance calls
+	void Preload(UNNEModelData* ModelData, int32 NumInstances = 1, const FString& RuntimeName = FString());
+
+	// Drops the cached model together with its preloaded and recycled instances, instances still in use stay valid
+	void Release(const UNNEModelData* ModelData);
+
+	// Forgets the model the asset was resolved to, so the next request reads its data again, called when the asset is edited or reimported
+	void Invalidate(const UNNEModelData* ModelData);
+
+	int32 NumPreloadedInstances(const UNNEModelData* ModelData, const FString& RuntimeName = FString()) const;
+
+private:
+	// Hash of the runtime model data and the runtime name
+	using FModelKey = TTuple<uint64, FString>;
+	using FAssetKey = TTuple<FObjectKey, FString>;
+
+	struct FModelEntry
+	{
+		// Held while the model is created so concurrent requests wait for the same model instead of creating their own
+		FCriticalSection CreateCriticalSection;
+		TSharedPtr<UE::NNE::IModelCPU> Model;
+		bool bCreateFailed = false;
+
+		TArray<TSharedPtr<FModelInstance>> PreloadedInstances;
+		TArray<TUniquePtr<UE::NNE::IModelInstanceCPU>> FreeInstances;
+	};
+
+	// Hashes the model data on first use, which may build the runtime data, so it is only called on background threads
+	TSharedPtr<FModelEntry> ResolveEntry(const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName);
+	TSharedPtr<FModelEntry> FindEntry(const UNNEModelData* ModelData, const FString& RuntimeName) const;
+
+	TSharedPtr<FModelInstance> CreateInstance(const TSharedRef<FModelEntry>& Entry, const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName);
+	TSharedPtr<FModelInstance> WrapInstance(const TSharedRef<FModelEntry>& Entry, TUniquePtr<UE::NNE::IModelInstanceCPU> Instance);
+	void RecycleInstance(const TWeakPtr<FModelEntry>& WeakEntry, FModelInstance* Instance);
+
+	// Returns the runtime the model should run on, benchmarking all CPU runtimes the first time if autotuning is enabled
+	FString SelectRuntime(const TWeakObjectPtr<UNNEModelData>& WeakModelData);
+	FString FindSelectedRuntime(const UNNEModelData* ModelData) const;
+
+	// Median time of a single inference in seconds, negative if the model could not be run
+	double BenchmarkRuntime(const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName, int32 Iterations);
+
+	void ReleaseRuntime(const FObjectKey& ObjectKey, const FString& RuntimeName);
+
+	static TSharedPtr<UE::NNE::IModelCPU> GetOrCreateModel(FModelEntry& Entry, const TWeakObjectPtr<UNNEModelData>& WeakModelData, const FString& RuntimeName);
+
+	mutable FCriticalSection EntriesCriticalSection;
+	TMap<FAssetKey, FModelKey> ModelKeys;
+	TMap<FModelKey, TSharedRef<FModelEntry>> Entries;
+	TMap<FObjectKey, FString> SelectedRuntimes;
+
+	// Held while the model data of an unknown asset is read and hashed, so it is only read once even if many instances are requested at the same time
+	FCriticalSection ResolveCriticalSection;
+
+	// Counts the assets that changed, a hash computed while one changed is not remembered as it may be of the old data
+	uint32 ChangeCount = 0;
+
+	// Held while a runtime is selected so a model is only benchmarked once
+	FCriticalSection SelectionCriticalSection;
+	TSharedPtr<FJsonObject> AutotuneCache;
+};
+
+UCLASS()
+class NEURALANIMATIONTOOLKIT_API UModelRegistryLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// Warms the model ahead of spawning characters that use it, e.g. when a streaming level starts loading
+	UFUNCTION(BlueprintCallable, Category = "Neural Network")
+	static void PreloadModel(UNNEModelData* ModelData, int32 NumInstances = 1);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Network")
+	static void ReleaseModel(UNNEModelData* ModelData);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Network")
+	static int32 GetNumPreloadedInstances(UNNEModelData* ModelData);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "NeuralAnimationToolkitSettings.generated.h"
+
+// Project settings of the Neural Animation Toolkit, found under Project Settings > Plugins
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "Neural Animation Toolkit"))
+class NEURALANIMATIONTOOLKIT_API UNeuralAnimationToolkitSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	UNeuralAnimationToolkitSettings();
+
+	// Name of the CPU runtime every model runs on, e.g. NNERuntimeORTCpu. Leave empty to pick the runtime per model
+	UPROPERTY(config, EditAnywhere, Category = "Inference")
+	FString RuntimeOverride;
+
+	// Benchmarks every registered CPU runtime the first time a model is used on a machine and keeps the fastest one
+	// The choice is stored in Saved/NeuralAnimationToolkit/RuntimeAutotune.json, delete it to benchmark again
+	UPROPERTY(config, EditAnywhere, Category = "Inference", meta = (EditCondition = "RuntimeOverride == \"\""))
+	bool bAutotuneRuntime = true;
+
+	// Number of timed inferences per runtime, the median is compared
+	UPROPERTY(config, EditAnywhere, Category = "Inference", meta = (EditCondition = "bAutotuneRuntime", ClampMin = 1))
+	int32 AutotuneIterations = 32;
+
+	// Threads dedicated to running asynchronous and pipelined inferences, read when the first inference is started
+	UPROPERTY(config, EditAnywhere, Category = "Inference Threads", meta = (ClampMin = 1, ConfigRestartRequired = true))
+	int32 NumInferenceThreads = 2;
+
+	// Bit mask of the cores the inference threads may run on, 0 lets them run on any core
+	UPROPERTY(config, EditAnywhere, Category = "Inference Threads", meta = (ConfigRestartRequired = true))
+	int64 InferenceThreadAffinityMask = 0;
+
+	// Runtime used when there is no override and autotuning is off, or when no runtime could be benchmarked
+	static const TCHAR* DefaultRuntimeName;
+
+	// UDeveloperSettings interface
+	virtual FName GetCategoryName() const override;
+	// End UDeveloperSettings interface
+};
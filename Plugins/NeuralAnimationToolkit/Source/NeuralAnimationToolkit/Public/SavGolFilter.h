@@ -1,20 +1,65 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "Kismet/KismetMathLibrary.h"
 
-class USavGolFilter
+// Determines how the frames at the start and end of the data are filtered
+enum class ESavGolMode : uint8
+{
+	Interp,		// The polynomial fitted to the first/last window is evaluated at the edge frames
+	Mirror,		// The data is reflected around the edge frames
+	Nearest,	// The edge frames are repeated
+	Constant,	// Frames outside the data take a constant value
+};
+
+class NEURALANIMATIONTOOLKIT_API USavGolFilter
 {
 public:
-	static TArray<FVector> SavGolFilter(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv = 0, float Delta = 1.0f, int32 Axis = -1, const FString& Mode = "interp", const FVector& Cval = FVector::ZeroVector);
+	static TArray<FVector> SavGolFilter(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv = 0, float Delta = 1.0f, ESavGolMode Mode = ESavGolMode::Interp, const FVector& Cval = FVector::ZeroVector);
+
+	// Filters a whole frames x channels matrix, stored frame by frame, with the same filter for every channel
+	// Channels are processed four at a time in vector registers so wide matrices run at memory bandwidth
+	// Windows longer than the data are shortened to the longest odd window that fits
+	static void FilterMatrix(const float* Input, float* Output, int32 NumFrames, int32 NumChannels, int32 WindowLength, int32 PolyOrder, int32 Deriv = 0, float Delta = 1.0f, ESavGolMode Mode = ESavGolMode::Interp, float Cval = 0.0f);
+
+	// Least squares weights of a polynomial fit over WindowLength samples, evaluated at sample Pos of the window
+	// The weights are in sample order (oldest first) and are applied as a dot product with the window, Pos = WindowLength - 1 gives a causal filter
+	static TArray<float> LeastSquaresCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv = 0, float Delta = 1.0f, int32 Pos = -1);
+
+	// Same weights for Delta = 1, computed once per parameter set and shared between threads
+	static const TArray<float>& GetCachedCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv, int32 Pos);
+
+private:
+	static int32 HandleBoundary(int32 Index, int32 Length, ESavGolMode Mode);
+};
+
+// Savitzky-Golay filter over a live stream of samples with many channels, e.g. the output bones of the neural network node
+// Every update pushes one sample per channel into a ring buffer and returns the polynomial fit evaluated Latency samples in the past,
+// so a latency of 0 is causal and larger latencies trade delay for a better centred fit
+// Optionally the first derivative of the fit is returned as well
+struct NEURALANIMATIONTOOLKIT_API FStreamingSavGolFilter
+{
+	void Initialize(int32 InNumChannels, int32 InWindowLength, int32 InPolyOrder, int32 InLatency = 0);
+
+	// The next sample fills the whole window
+	void Reset();
+
+	// Overwrites Values with the filtered values, DeltaTime is the time between samples and only used for the derivative
+	void Update(TArray<float>& Values, float DeltaTime, TArray<float>* OutDerivatives = nullptr);
+
+	int32 Num() const { return NumChannels; }
+	int32 GetLatency() const { return Latency; }
 
 private:
-	static int32 HandleBoundary(int32 Index, int32 Length, const FString& Mode);
-	static TArray<FVector> Correlate1D(const TArray<FVector>& Input, const TArray<float>& Weights, int32 Axis = -1, const FString& Mode = "reflect", const FVector& CVal = FVector::ZeroVector, int32 Origin = 0);
-	static TArray<FVector> Convolve1D(const TArray<FVector>& Input, TArray<float>& Weights, int32 Axis = -1, const FString& Mode = "reflect", const FVector& CVal = FVector::ZeroVector, int32 Origin = 0);
-	static TArray<FVector> Slice(const TArray<FVector>& array, int32 start, int32 stop);
-	static TArray<float> SavGolCoeffs(int32 WindowLength, int32 PolyOrder, int32 Deriv = 0, float Delta = 1.0f, int32 Pos = -1, const FString& Use = "conv");
-	static void FitEdgesPolyFit(const TArray<FVector>& X, int32 WindowLength, int32 PolyOrder, int32 Deriv, float Delta, TArray<FVector>& Y);
-	static void FitEdge(const TArray<FVector>& X, int32 WindowStart, int32 WindowStop, int32 InterpStart, int32 InterpStop, int32 Axis, int32 PolyOrder, int32 Deriv, float Delta, TArray<FVector>& Y);
-	static TArray<float> PolyDer(const TArray<float>& P, int32 M);
+	int32 NumChannels = 0;
+	int32 WindowLength = 0;
+	int32 Latency = 0;
+
+	// Oldest sample first
+	TArray<float> Coefficients;
+	TArray<float> DerivativeCoefficients;
+
+	// WindowLength samples of NumChannels floats, Head is the oldest one
+	TArray<float> History;
+	int32 Head = 0;
+	bool bHasSamples = false;
 };
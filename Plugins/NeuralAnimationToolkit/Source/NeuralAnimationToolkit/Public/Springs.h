@@ -5,66 +5,54 @@
 #include "FeatureComputation.h"
 #include "Springs.generated.h"
 
+// Tracking spring for many scalar channels at once, e.g. every float of the model output vector
+// Each channel follows its goal together with the velocity and acceleration estimated from the last goals, clamped to v_max and a_max
+// The goal history is a fixed size ring shared by all channels and the spring transition is computed once per update for all channels
 USTRUCT(BlueprintType)
-struct NEURALANIMATIONTOOLKIT_API FSpring {
-
+struct NEURALANIMATIONTOOLKIT_API FTrackingSpringBank
+{
 	GENERATED_BODY()
 
-	float x = 0.0f;
-	float v = 0.0f;
-
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
 	float x_gain = 0.01f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
 	float v_gain = 0.2f;
-	float a_gain = 1.0f;
 
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float a_gain = 0.1f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
 	float v_max = 500.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
 	float a_max = 500.0f;
 
-	float* g_prev;
-	float prev_size = 3;
+	// Number of previous goals kept per channel, enough for the acceleration estimate
+	static constexpr int32 HistorySize = 2;
+
+	FTrackingSpringBank(float InXGain = 0.01f, float InVGain = 0.2f, float InAGain = 0.1f);
+
+	void Initialize(int32 InNumChannels);
+
+	// Channels snap to the goals of the next Update
+	void Reset();
 
-	FSpring(int prev_size = 3, float x_gain = 0.01f, float v_gain = 0.2f, float a_gain = 0.1f);
+	// Moves every channel towards its goal and overwrites the goals with the spring state, does nothing if dt is not positive
+	void Update(TArray<float>& Values, const float dt);
 
-	void update(float g, const float dt);
+	int32 Num() const { return NumChannels; }
 
 private:
-	void tracking_spring_update_exact(
-		float x_goal,
-		float v_goal,
-		float a_goal,
-		const float dt,
-		float gain_dt);
-
-	void tracking_spring_update_no_acceleration_exact(
-		float x_goal,
-		float v_goal,
-		const float dt,
-		float gain_dt);
-
-	void tracking_spring_update_no_velocity_acceleration_exact(
-		float x_goal,
-		const float dt,
-		float gain_dt);
-
-	float tracking_target_acceleration(
-		float x_next,
-		float x_curr,
-		float x_prev,
-		const float dt);
-
-	float tracking_target_velocity(
-		float x_next,
-		float x_curr,
-		const float dt);
-
-	void spring_damper_exact_stiffness_damping(
-		float x_goal,
-		float v_goal,
-		float stiffness,
-		float damping,
-		const float dt,
-		float eps = 1e-5f);
+	float* GetStream(int32 Stream) { return Streams.GetData() + Stream * PaddedNumChannels; }
 
+	int32 NumChannels = 0;
+	int32 PaddedNumChannels = 0;
+	int32 HistoryHead = 0;
+	bool bHasState = false;
+
+	// Position, velocity, goal and HistorySize previous goals, PaddedNumChannels floats each
+	TArray<float, TAlignedHeapAllocator<16>> Streams;
 };
 
 USTRUCT(BlueprintType)
@@ -120,6 +108,103 @@ private:
 	FQuatSpring rotationSpring;
 };
 
+// Batched FTransformSpring for all the output bones of a character
+// Positions, rotations and velocities are stored as structure of arrays so four bones are updated at once in vector registers
+// The decay factor is computed once per update instead of once per bone
+USTRUCT(BlueprintType)
+struct NEURALANIMATIONTOOLKIT_API FTransformSpringBank
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float halfLife = 0.1f;
+
+	FTransformSpringBank(float HalfLife = 0.1f);
+
+	// Resizes the bank, the springs start at the first goals passed to Update
+	void Initialize(int32 InNumBones);
+
+	// Springs snap to the goals of the next Update
+	void Reset();
+
+	// Moves every spring towards its goal and overwrites the goals with the spring state
+	void Update(TArray<FVector>& Positions, TArray<FQuat>& Rotations, const float dt);
+
+	int32 Num() const { return NumBones; }
+
+private:
+	float* GetStream(int32 Stream) { return Streams.GetData() + Stream * PaddedNumBones; }
+
+	int32 NumBones = 0;
+	int32 PaddedNumBones = 0;
+	bool bHasState = false;
+
+	// One stream of PaddedNumBones floats per component, see ESpringBankStream
+	TArray<float, TAlignedHeapAllocator<16>> Streams;
+};
+
+// Offset based inertialisation for all the output bones of a character
+// Instead of damping every bone every frame, the difference between the last output and the new goal is captured when a discontinuity happens
+// and decayed to zero in closed form on top of the goal. Bones whose offset has decayed below the epsilons are skipped entirely.
+USTRUCT(BlueprintType)
+struct NEURALANIMATIONTOOLKIT_API FOffsetInertializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float halfLife = 0.1f;
+
+	// Goal jumps above these thresholds are treated as discontinuities, 0 disables the check
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float PositionThreshold = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float RotationThreshold = 0.0f;
+
+	// Offsets below these values are considered converged
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float PositionEpsilon = 0.01f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spring")
+	float RotationEpsilon = 0.0001f;
+
+	FOffsetInertializer(float HalfLife = 0.1f);
+
+	void Initialize(int32 InNumBones);
+
+	// Drops all offsets, the next goals are output as they are
+	void Reset();
+
+	// Applies the decaying offsets to the goals
+	// bDiscontinuity captures a new offset for every bone, e.g. when the model changed or a new async result arrived
+	void Update(TArray<FVector>& Positions, TArray<FQuat>& Rotations, const float dt, bool bDiscontinuity);
+
+	int32 Num() const { return Bones.Num(); }
+	int32 NumActive() const { return ActiveBones.Num(); }
+
+private:
+	struct FBoneOffset
+	{
+		FVector Position = FVector::ZeroVector;
+		FVector Velocity = FVector::ZeroVector;
+		FVector Rotation = FVector::ZeroVector; // Scaled angle axis
+		FVector AngularVelocity = FVector::ZeroVector;
+		bool bActive = false;
+	};
+
+	void CaptureOffset(int32 BoneIndex, const FVector& Position, const FQuat& Rotation);
+
+	TArray<FBoneOffset> Bones;
+	TArray<int32> ActiveBones;
+
+	// Last output and goal of each bone
+	TArray<FVector> PrevPositions;
+	TArray<FQuat> PrevRotations;
+	TArray<FVector> PrevGoalPositions;
+	TArray<FQuat> PrevGoalRotations;
+	bool bHasState = false;
+};
+
 UCLASS(Abstract)
 class NEURALANIMATIONTOOLKIT_API UQuatHelper : public UObject
 {
@@ -0,0 +1,39 @@
+using UnrealBuildTool;
+
+public class NeuralAnimationToolkitEditor : ModuleRules
+{
+    public NeuralAnimationToolkitEditor(ReadOnlyTargetRules Target) : base(Target)
+    {
+        PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+        PublicDependencyModuleNames.AddRange(new string[]
+        {
+            "Core",
+            "CoreUObject",
+            "Engine",
+            "Slate",
+            "SlateCore",
+            "UMG",
+            "AnimationCore",
+            "AnimGraphRuntime",
+            "AnimGraph",
+            "StructUtils",
+            "BlueprintGraph",
+            "NeuralAnimationToolkit",
+        });
+
+        PrivateDependencyModuleNames.AddRange(new string[]
+        {
+            "Projects",
+            "EditorFramework",
+            "UnrealEd",
+            "ToolMenus",
+            "Blutility",
+            "UMGEditor",
+            "ScriptableEditorWidgets",
+            "CollectionManager",
+            "Json",
+            "LevelEditor",
+        });
+    }
+}
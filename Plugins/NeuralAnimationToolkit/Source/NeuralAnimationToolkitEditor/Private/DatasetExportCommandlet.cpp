@@ -0,0 +1,199 @@
+#include "DatasetExportCommandlet.h"
+#include "DatasetExporter.h"
+#include "Features.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "CollectionManagerModule.h"
+#include "ICollectionManager.h"
+#include "Internationalization/Regex.h"
+
+UDatasetExportCommandlet::UDatasetExportCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UDatasetExportCommandlet::Main(const FString& Params)
+{
+	FString FeatureSetPath;
+	FString OutputFolder;
+	FString BoneList = TEXT("all");
+	FString SequencePath;
+	FString SequenceRegex;
+	FString CollectionName;
+	int32 NumWorkers = 0;
+	int32 FramesPerShard = 0;
+	FString Encoding;
+	FString Compression;
+	int32 HistoryLength = INDEX_NONE;
+	int32 FutureLength = INDEX_NONE;
+
+	FParse::Value(*Params, TEXT("FeatureSet="), FeatureSetPath);
+	FParse::Value(*Params, TEXT("Output="), OutputFolder);
+	FParse::Value(*Params, TEXT("Bones="), BoneList, false);
+	FParse::Value(*Params, TEXT("Path="), SequencePath);
+	FParse::Value(*Params, TEXT("Regex="), SequenceRegex, false);
+	FParse::Value(*Params, TEXT("Collection="), CollectionName);
+	FParse::Value(*Params, TEXT("Workers="), NumWorkers);
+	FParse::Value(*Params, TEXT("Shards="), FramesPerShard);
+	FParse::Value(*Params, TEXT("Encoding="), Encoding);
+	FParse::Value(*Params, TEXT("Compression="), Compression);
+	FParse::Value(*Params, TEXT("History="), HistoryLength);
+	FParse::Value(*Params, TEXT("Future="), FutureLength);
+
+	if (FeatureSetPath.IsEmpty() || OutputFolder.IsEmpty())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Usage: -run=DatasetExport -FeatureSet=<asset path> -Output=<folder> [-Bones=all|bone1,bone2] [-Path=<content path>] [-Regex=<pattern>] [-Collection=<name>] [-Workers=<count>] [-Shards=<frames>] [-Encoding=Float32|Float16|Quantized16|Quantized8] [-Compression=None|LZ4|Zlib|Oodle] [-History=<frames>] [-Future=<frames>]"));
+		return 1;
+	}
+
+	if (!OutputFolder.EndsWith(TEXT("/")) && !OutputFolder.EndsWith(TEXT("\\")))
+	{
+		OutputFolder += TEXT("/");
+	}
+
+	UFeatureSet* FeatureSet = LoadObject<UFeatureSet>(nullptr, *FeatureSetPath);
+	if (!FeatureSet || !FeatureSet->Skeleton)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not load feature set %s or it has no skeleton assigned"), *FeatureSetPath);
+		return 1;
+	}
+
+	// The asset registry has to be complete before the skeleton referencers can be searched
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(FName("AssetRegistry"));
+	AssetRegistryModule.Get().SearchAllAssets(true);
+
+	FDatasetExportRequest Request;
+	Request.FeatureSet = FeatureSet;
+	Request.ExportFolder = OutputFolder;
+	Request.NumWorkers = NumWorkers;
+	Request.Options = FeatureSet->ExportOptions;
+
+	// Export options
+	if (FramesPerShard > 0)
+	{
+		Request.Options.bSharded = true;
+		Request.Options.FramesPerShard = FramesPerShard;
+	}
+
+	if (!Encoding.IsEmpty())
+	{
+		const int64 Value = StaticEnum<EBinaryEncoding>()->GetValueByNameString(Encoding);
+		if (Value == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Unknown encoding %s"), *Encoding);
+			return 1;
+		}
+		Request.Options.Encoding = static_cast<EBinaryEncoding>(Value);
+	}
+
+	if (!Compression.IsEmpty())
+	{
+		const int64 Value = StaticEnum<EBinaryCompression>()->GetValueByNameString(Compression);
+		if (Value == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Unknown compression %s"), *Compression);
+			return 1;
+		}
+		Request.Options.Compression = static_cast<EBinaryCompression>(Value);
+	}
+
+	if (HistoryLength >= 0 || FutureLength >= 0)
+	{
+		Request.Options.bExportWindows = true;
+		Request.Options.HistoryLength = HistoryLength >= 0 ? HistoryLength : Request.Options.HistoryLength;
+		Request.Options.FutureLength = FutureLength >= 0 ? FutureLength : Request.Options.FutureLength;
+	}
+
+	// Bones
+	TArray<FString> BoneNames;
+	BoneList.ParseIntoArray(BoneNames, TEXT(","), true);
+	const bool bAllBones = BoneNames.Num() == 0 || (BoneNames.Num() == 1 && BoneNames[0].Equals(TEXT("all"), ESearchCase::IgnoreCase));
+
+	const TArray<FMeshBoneInfo>& RefBoneInfo = FeatureSet->Skeleton->GetReferenceSkeleton().GetRefBoneInfo();
+	for (int32 i = 0; i < RefBoneInfo.Num(); i++)
+	{
+		FDatasetExportBone& ExportBone = Request.Bones.AddDefaulted_GetRef();
+		ExportBone.BoneName = RefBoneInfo[i].Name;
+		ExportBone.BoneIndex = i;
+		ExportBone.ParentIndex = RefBoneInfo[i].ParentIndex;
+		ExportBone.bIsSelected = bAllBones || BoneNames.ContainsByPredicate([&ExportBone](const FString& BoneName) { return ExportBone.BoneName == FName(*BoneName.TrimStartAndEnd()); });
+	}
+
+	// A misspelt bone would silently be left out of the dataset, which is easy to miss on a build farm
+	if (!bAllBones)
+	{
+		bool bAllBonesFound = true;
+		for (const FString& BoneName : BoneNames)
+		{
+			if (FeatureSet->Skeleton->GetReferenceSkeleton().FindBoneIndex(FName(*BoneName.TrimStartAndEnd())) == INDEX_NONE)
+			{
+				UE_LOG(LogTemp, Error, TEXT("Bone %s does not exist in skeleton %s"), *BoneName, *FeatureSet->Skeleton->GetName());
+				bAllBonesFound = false;
+			}
+		}
+
+		if (!bAllBonesFound)
+		{
+			return 1;
+		}
+	}
+
+	// Sequences
+	TSet<FSoftObjectPath> CollectionAssets;
+	if (!CollectionName.IsEmpty())
+	{
+		TArray<FSoftObjectPath> AssetPaths;
+		FCollectionManagerModule::GetModule().Get().GetAssetsInCollection(FName(*CollectionName), ECollectionShareType::CST_All, AssetPaths);
+		CollectionAssets.Append(AssetPaths);
+
+		if (CollectionAssets.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Collection %s is empty or does not exist"), *CollectionName);
+		}
+	}
+
+	// Compared with a trailing slash on both sides, so /Game/Anim matches /Game/Anim/Run but not /Game/Animations
+	if (!SequencePath.IsEmpty() && !SequencePath.EndsWith(TEXT("/")))
+	{
+		SequencePath += TEXT("/");
+	}
+
+	const FRegexPattern Pattern(SequenceRegex);
+
+	for (const FAssetData& Asset : FDatasetExporter::FindAnimSequences(FeatureSet->Skeleton))
+	{
+		const FString ObjectPath = Asset.GetObjectPathString();
+
+		if (!SequencePath.IsEmpty() && !(Asset.PackagePath.ToString() + TEXT("/")).StartsWith(SequencePath))
+		{
+			continue;
+		}
+
+		if (!SequenceRegex.IsEmpty())
+		{
+			FRegexMatcher Matcher(Pattern, ObjectPath);
+			if (!Matcher.FindNext())
+			{
+				continue;
+			}
+		}
+
+		if (!CollectionName.IsEmpty() && !CollectionAssets.Contains(Asset.GetSoftObjectPath()))
+		{
+			continue;
+		}
+
+		Request.Sequences.Add(Asset.GetSoftObjectPath());
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Exporting %d sequences with feature set %s to %s"), Request.Sequences.Num(), *FeatureSetPath, *OutputFolder);
+
+	FDatasetExporter Exporter(Request);
+	FDatasetExportTimings Timings;
+	const EDatasetExportResult Result = Exporter.Run(Timings);
+
+	return Result == EDatasetExportResult::Success ? 0 : 1;
+}
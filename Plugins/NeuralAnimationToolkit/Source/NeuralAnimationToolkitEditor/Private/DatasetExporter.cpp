@@ -0,0 +1,756 @@
+#include "DatasetExporter.h"
+#include "BinaryBuilder.h"
+#include "Animation/AnimSequence.h"
+#include "AssetRegistry/AssetData.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "AssetRegistry/IAssetRegistry.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "SavGolFilter.h"
+#include "Misc/ScopedSlowTask.h"
+#include "UObject/GCObjectScopeGuard.h"
+
+#define LOCTEXT_NAMESPACE "DatasetExporter"
+
+// Number of exported sequences after which the released ones are garbage collected
+static constexpr int32 GarbageCollectionInterval = 64;
+
+FDatasetExportTimings& FDatasetExportTimings::operator+=(const FDatasetExportTimings& Other)
+{
+	Decode += Other.Decode;
+	Filter += Other.Filter;
+	ForwardKinematics += Other.ForwardKinematics;
+	Serialization += Other.Serialization;
+	Features += Other.Features;
+	FileWrite += Other.FileWrite;
+	return *this;
+}
+
+FString FDatasetExportTimings::ToString() const
+{
+	return FString::Printf(TEXT("Decode %.2fs, Filter %.2fs, FK %.2fs, Serialization %.2fs, Features %.2fs, File Write %.2fs (Total %.2fs)"),
+		Decode, Filter, ForwardKinematics, Serialization, Features, FileWrite, Total);
+}
+
+FDatasetExporter::FDatasetExporter(const FDatasetExportRequest& InRequest)
+	: Request(InRequest)
+{
+	for (const FDatasetExportBone& Bone : Request.Bones)
+	{
+		if (Bone.bIsSelected)
+		{
+			SelectedBones.Add(Bone);
+		}
+	}
+}
+
+EDatasetExportResult FDatasetExporter::Run(FDatasetExportTimings& OutTimings)
+{
+	check(IsInGameThread());
+
+	OutTimings = FDatasetExportTimings();
+	const double StartTime = FPlatformTime::Seconds();
+
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+	if (!FeatureSet || Request.Bones.Num() == 0 || Request.Sequences.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Nothing to export"));
+		return EDatasetExportResult::Failed;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Exporting data..."));
+
+	// Garbage is collected during the export, keep the feature set alive even when nothing else references it
+	FGCObjectScopeGuard FeatureSetGuard(FeatureSet);
+
+	// The selected bones become the output bones of the feature set
+	FeatureSet->OutputBones.Empty();
+	for (const FDatasetExportBone& Bone : SelectedBones)
+	{
+		FBoneReference BoneRef;
+		BoneRef.BoneName = Bone.BoneName;
+		FeatureSet->OutputBones.Add(BoneRef);
+	}
+
+	// Features only read the bone transforms during offline computation so they can be shared between workers once initialised
+	if (FeatureSet->Skeleton)
+	{
+		FeatureSet->InitialiseFeaturesOffline(FeatureSet->Skeleton->GetReferenceSkeleton());
+	}
+
+	const int32 NumWorkers = Request.NumWorkers > 0 ? Request.NumWorkers : FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads());
+
+	const int32 BoneCount = SelectedBones.Num();
+	const int32 BoneVectorSize = BoneCount > 0 ? FeatureSet->GetDatasetVectorSize() / BoneCount : 0;
+
+	// The writers delete their temporary files if the export is cancelled or fails
+	TUniquePtr<FBinaryFileWriter> DatasetWriter = CreateFileWriter(TEXT("dataset.bin"), { BoneCount, BoneVectorSize });
+	TUniquePtr<FBinaryFileWriter> FeatureWriter = CreateFileWriter(TEXT("features.bin"), { FeatureSet->GetFeatureVectorSize() });
+
+	TArray<FSequenceResult> Results;
+	TArray<int32> SequenceFrames;
+	SequenceFrames.Reserve(Request.Sequences.Num());
+
+	FScopedSlowTask SlowTask(static_cast<float>(Request.Sequences.Num()) + 1.0f, LOCTEXT("ExportingDataset", "Exporting dataset..."));
+	if (!IsRunningCommandlet())
+	{
+		SlowTask.MakeDialog(true);
+	}
+
+	// The next batch is loaded in the background while the current one is processed
+	TSharedPtr<FStreamableHandle> NextBatchHandle = RequestSequenceBatch(0, NumWorkers);
+	int32 SequencesSinceGarbageCollection = 0;
+
+	for (int32 BatchStart = 0; BatchStart < Request.Sequences.Num(); BatchStart += NumWorkers)
+	{
+		if (SlowTask.ShouldCancel())
+		{
+			if (NextBatchHandle.IsValid())
+			{
+				NextBatchHandle->CancelHandle();
+			}
+			UE_LOG(LogTemp, Warning, TEXT("Export cancelled, no files were written"));
+			return EDatasetExportResult::Cancelled;
+		}
+
+		const int32 BatchSize = FMath::Min(NumWorkers, Request.Sequences.Num() - BatchStart);
+
+		SlowTask.EnterProgressFrame(static_cast<float>(BatchSize), FText::Format(LOCTEXT("ExportingSequence", "Exporting {0} ({1}/{2})"),
+			FText::FromString(Request.Sequences[BatchStart].GetAssetName()), BatchStart + 1, Request.Sequences.Num()));
+
+		TSharedPtr<FStreamableHandle> BatchHandle = NextBatchHandle;
+		NextBatchHandle = RequestSequenceBatch(BatchStart + NumWorkers, NumWorkers);
+
+		if (BatchHandle.IsValid())
+		{
+			BatchHandle->WaitUntilComplete();
+		}
+
+		TArray<UAnimSequence*> Batch;
+		Batch.SetNumZeroed(BatchSize);
+		for (int32 Index = 0; Index < BatchSize; Index++)
+		{
+			Batch[Index] = Cast<UAnimSequence>(Request.Sequences[BatchStart + Index].ResolveObject());
+			if (!Batch[Index])
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Failed to load %s, skipping"), *Request.Sequences[BatchStart + Index].ToString());
+			}
+#if WITH_EDITOR
+			// Make sure the compressed data is ready before the sequences are sampled from worker threads
+			else
+			{
+				Batch[Index]->CacheDerivedDataForCurrentPlatform();
+			}
+#endif
+		}
+
+		Results.Reset();
+		Results.SetNum(BatchSize);
+
+		ParallelFor(BatchSize, [this, &Batch, &Results](int32 Index)
+			{
+				ProcessSequence(Batch[Index], Results[Index]);
+			});
+
+		const double WriteStartTime = FPlatformTime::Seconds();
+		for (const FSequenceResult& Result : Results)
+		{
+			OutTimings += Result.Timings;
+			SequenceFrames.Add(Result.NumFrames);
+
+			if (!DatasetWriter->Append(Result.Data, Result.NumFrames) || !FeatureWriter->Append(Result.FeatureData, Result.NumFrames))
+			{
+				if (NextBatchHandle.IsValid())
+				{
+					NextBatchHandle->CancelHandle();
+				}
+				UE_LOG(LogTemp, Error, TEXT("Failed to write the dataset to %s"), *GetFilePath(TEXT("")));
+				return EDatasetExportResult::Failed;
+			}
+		}
+		OutTimings.FileWrite += FPlatformTime::Seconds() - WriteStartTime;
+
+		// Release the processed sequences so the memory stays flat on large libraries
+		if (BatchHandle.IsValid())
+		{
+			BatchHandle->ReleaseHandle();
+		}
+
+		SequencesSinceGarbageCollection += BatchSize;
+		if (SequencesSinceGarbageCollection >= GarbageCollectionInterval)
+		{
+			Batch.Empty();
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+			SequencesSinceGarbageCollection = 0;
+		}
+	}
+
+	SlowTask.EnterProgressFrame(1.0f, LOCTEXT("WritingFiles", "Writing files..."));
+
+	const bool bWritten = WriteFiles(SequenceFrames, *DatasetWriter, *FeatureWriter, OutTimings);
+
+	OutTimings.Total = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogTemp, Warning, TEXT("Export timings: %s"), *OutTimings.ToString());
+
+	return bWritten ? EDatasetExportResult::Success : EDatasetExportResult::Failed;
+}
+
+TSharedPtr<FStreamableHandle> FDatasetExporter::RequestSequenceBatch(int32 BatchStart, int32 BatchSize)
+{
+	if (BatchStart >= Request.Sequences.Num())
+	{
+		return nullptr;
+	}
+
+	TArray<FSoftObjectPath> BatchPaths;
+	for (int32 Index = BatchStart; Index < FMath::Min(BatchStart + BatchSize, Request.Sequences.Num()); Index++)
+	{
+		BatchPaths.Add(Request.Sequences[Index]);
+	}
+
+	return StreamableManager.RequestAsyncLoad(BatchPaths, FStreamableDelegate(), FStreamableManager::AsyncLoadHighPriority);
+}
+
+bool FDatasetExporter::GetSequenceInfo(const FAssetData& AssetData, int32& OutNumFrames, float& OutSequenceLength)
+{
+	OutNumFrames = INDEX_NONE;
+	OutSequenceLength = 0.0f;
+
+	// Tags written by UAnimSequence::GetAssetRegistryTags and UAnimSequenceBase::GetAssetRegistryTags
+	const bool bHasFrames = AssetData.GetTagValue(FName(TEXT("Number of Keys")), OutNumFrames) || AssetData.GetTagValue(FName(TEXT("Number of Frames")), OutNumFrames);
+	const bool bHasLength = AssetData.GetTagValue(FName(TEXT("Sequence Length")), OutSequenceLength);
+
+	return bHasFrames && bHasLength;
+}
+
+TArray<FAssetData> FDatasetExporter::FindAnimSequences(const USkeleton* Skeleton)
+{
+	TArray<FAssetData> AnimSequences;
+
+	if (!Skeleton)
+	{
+		return AnimSequences;
+	}
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(FName("AssetRegistry"));
+	IAssetRegistry& AssetRegistry = AssetRegistryModule.Get();
+
+	// Search for referencing packages to the skeleton
+	TArray<FAssetIdentifier> Referencers;
+	AssetRegistry.GetReferencers(Skeleton->GetOuter()->GetFName(), Referencers);
+	for (const FAssetIdentifier& Identifier : Referencers)
+	{
+		TArray<FAssetData> Assets;
+		AssetRegistry.GetAssetsByPackageName(Identifier.PackageName, Assets);
+
+		for (const FAssetData& Asset : Assets)
+		{
+			// Only add assets whos class is of UAnimSequence
+			if (Asset.IsInstanceOf(UAnimSequence::StaticClass()))
+			{
+				AnimSequences.Add(Asset);
+			}
+		}
+	}
+
+	return AnimSequences;
+}
+
+void FDatasetExporter::ProcessSequence(UAnimSequence* AnimSequence, FSequenceResult& OutResult) const
+{
+	if (!AnimSequence)
+	{
+		return;
+	}
+
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+	const float FrameRate = AnimSequence->GetPlayLength() / AnimSequence->GetNumberOfSampledKeys();
+
+	double StageStart = FPlatformTime::Seconds();
+	TArray<TArray<FTransform>> LocalBoneTransforms = GetBoneTransforms(AnimSequence);
+	double StageEnd = FPlatformTime::Seconds();
+	OutResult.Timings.Decode += StageEnd - StageStart;
+
+	if (FeatureSet->bDenoiseWithSavGol)
+	{
+		StageStart = StageEnd;
+		DenoiseBoneTransforms(LocalBoneTransforms);
+		StageEnd = FPlatformTime::Seconds();
+		OutResult.Timings.Filter += StageEnd - StageStart;
+	}
+
+	StageStart = StageEnd;
+	TArray<TArray<FTransform>> ComponentSpaceBoneTransforms = RetrieveComponentSpaceTransforms(LocalBoneTransforms);
+	StageEnd = FPlatformTime::Seconds();
+	OutResult.Timings.ForwardKinematics += StageEnd - StageStart;
+
+	StageStart = StageEnd;
+	if (static_cast<uint8>(FeatureSet->TransformType) & static_cast<uint8>(EFeatureBoneTransformFlags::Local)) {
+		OutResult.Data.Append(SerializeBoneTransforms(LocalBoneTransforms, FrameRate));
+	}
+	if (static_cast<uint8>(FeatureSet->TransformType) & static_cast<uint8>(EFeatureBoneTransformFlags::ComponentSpace)) {
+		OutResult.Data.Append(SerializeBoneTransforms(ComponentSpaceBoneTransforms, FrameRate));
+	}
+	StageEnd = FPlatformTime::Seconds();
+	OutResult.Timings.Serialization += StageEnd - StageStart;
+
+	StageStart = StageEnd;
+	OutResult.FeatureData = FeatureSet->ComputeFeaturesOffline(LocalBoneTransforms, ComponentSpaceBoneTransforms, FrameRate);
+	StageEnd = FPlatformTime::Seconds();
+	OutResult.Timings.Features += StageEnd - StageStart;
+
+	OutResult.NumFrames = LocalBoneTransforms.Num();
+}
+
+TUniquePtr<FBinaryFileWriter> FDatasetExporter::CreateFileWriter(const FString& FileName, const TArray<int32>& RowDimensions) const
+{
+	// Large arrays are optionally split into compressed shards, "dataset.bin" becomes "dataset.bin.manifest.json" and "dataset.bin.00000.bin", ...
+	if (Request.Options.bSharded)
+	{
+		return MakeUnique<FBinaryFileWriter>(GetFilePath(FileName), RowDimensions, Request.Options.FramesPerShard, Request.Options.Encoding, Request.Options.Compression, TEXT(".tmp"));
+	}
+	return MakeUnique<FBinaryFileWriter>(GetFilePath(FileName), RowDimensions, TEXT(".tmp"));
+}
+
+bool FDatasetExporter::WriteFiles(const TArray<int32>& SequenceFrames, FBinaryFileWriter& DatasetWriter, FBinaryFileWriter& FeatureWriter, FDatasetExportTimings& OutTimings) const
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+
+	const int64 FrameCount = DatasetWriter.GetNumRows();
+	const int32 BoneCount = SelectedBones.Num();
+	const int32 FeatureSize = FeatureSet->GetFeatureVectorSize();
+
+	TArray<int32> ParentIndices = GetBoneParentIndices();
+
+	TArray<FString> WrittenFiles;
+	bool bSuccess = true;
+
+	auto WriteFile = [this, &WrittenFiles, &bSuccess](const FString& FileName, const TArray<int32>& Dimensions, const auto& FileData)
+		{
+			if (!bSuccess)
+			{
+				return;
+			}
+			const FString TempFilePath = GetFilePath(FileName) + TEXT(".tmp");
+			bSuccess = UBinaryBuilder::SaveToBinaryFile(TempFilePath, Dimensions, FileData);
+			WrittenFiles.Add(GetFilePath(FileName));
+		};
+
+	// Start frame and frame count of every sequence in the flat dataset, frame indices are stored as int32
+	TArray<int32> Sequences;
+	Sequences.Reserve(SequenceFrames.Num() * 2);
+	int64 SequenceStart = 0;
+	for (const int32 NumFrames : SequenceFrames)
+	{
+		Sequences.Add(static_cast<int32>(SequenceStart));
+		Sequences.Add(NumFrames);
+		SequenceStart += NumFrames;
+	}
+
+	if (FrameCount > MAX_int32)
+	{
+		UE_LOG(LogTemp, Error, TEXT("The dataset holds %lld frames, at most %d can be exported"), FrameCount, MAX_int32);
+		bSuccess = false;
+	}
+
+	WriteFile(TEXT("parent_indices.bin"), { ParentIndices.Num() }, ParentIndices);
+	WriteFile(TEXT("sequences.bin"), { SequenceFrames.Num(), 2 }, Sequences);
+
+	if (Request.Options.bExportWindows && bSuccess)
+	{
+		const int32 WindowLength = FMath::Max(1, Request.Options.HistoryLength + Request.Options.FutureLength);
+
+		TArray<int32> Windows;
+		Windows.Reserve(static_cast<int32>(FrameCount));
+		for (int32 SequenceIndex = 0; SequenceIndex < SequenceFrames.Num(); SequenceIndex++)
+		{
+			const int32 Start = Sequences[SequenceIndex * 2];
+			const int32 NumFrames = Sequences[SequenceIndex * 2 + 1];
+			for (int32 Frame = 0; Frame + WindowLength <= NumFrames; Frame++)
+			{
+				Windows.Add(Start + Frame);
+			}
+		}
+
+		WriteFile(TEXT("windows.bin"), { Windows.Num() }, Windows);
+	}
+
+	bSuccess = bSuccess && DatasetWriter.Finish(WrittenFiles);
+	bSuccess = bSuccess && FeatureWriter.Finish(WrittenFiles);
+
+	// Only move the files in place once all of them were written successfully
+	// Every file of a previous export is moved aside first, including the ones this export does not write again (windows.bin, the other layout, extra shards)
+	// so they can be restored if any move fails and the folder never mixes two exports
+	IFileManager& FileManager = IFileManager::Get();
+	TArray<FString> BackedUpFiles;
+	TArray<FString> CommittedFiles;
+
+	for (const FString& FilePath : FindPreviousExportFiles())
+	{
+		if (!bSuccess)
+		{
+			break;
+		}
+		bSuccess = UBinaryBuilder::CommitFile(FilePath, FilePath + TEXT(".bak"));
+		if (bSuccess)
+		{
+			BackedUpFiles.Add(FilePath);
+		}
+	}
+
+	for (const FString& FilePath : WrittenFiles)
+	{
+		if (!bSuccess)
+		{
+			break;
+		}
+		bSuccess = UBinaryBuilder::CommitFile(FilePath + TEXT(".tmp"), FilePath);
+		if (bSuccess)
+		{
+			CommittedFiles.Add(FilePath);
+		}
+	}
+
+	if (!bSuccess)
+	{
+		for (const FString& FilePath : CommittedFiles)
+		{
+			FileManager.Delete(*UBinaryBuilder::GetAbsolutePath(FilePath));
+		}
+		for (const FString& FilePath : BackedUpFiles)
+		{
+			if (!UBinaryBuilder::CommitFile(FilePath + TEXT(".bak"), FilePath))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to restore %s, the previous export is kept in %s.bak"), *FilePath, *FilePath);
+			}
+		}
+	}
+	else
+	{
+		for (const FString& FilePath : BackedUpFiles)
+		{
+			FileManager.Delete(*UBinaryBuilder::GetAbsolutePath(FilePath + TEXT(".bak")));
+		}
+	}
+
+	for (const FString& FilePath : WrittenFiles)
+	{
+		const FString TempFilePath = UBinaryBuilder::GetAbsolutePath(FilePath + TEXT(".tmp"));
+		if (FileManager.FileExists(*TempFilePath))
+		{
+			FileManager.Delete(*TempFilePath);
+		}
+	}
+
+	OutTimings.FileWrite += FPlatformTime::Seconds() - StartTime;
+
+	if (bSuccess)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Exported data to %s"), *GetFilePath(TEXT("")));
+		UE_LOG(LogTemp, Warning, TEXT("Exported %lld frames, %d bones, %d features"), FrameCount, BoneCount, FeatureSize);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to write the dataset to %s"), *GetFilePath(TEXT("")));
+	}
+
+	return bSuccess;
+}
+
+// Retrieve frame-by-frame bone transforms for all bones of the skeleton in the selected animation sequence
+TArray<TArray<FTransform>> FDatasetExporter::GetBoneTransforms(UAnimSequence* AnimSequence) const
+{
+	TArray<TArray<FTransform>> AnimationData;
+
+	if (AnimSequence)
+	{
+		const FReferenceSkeleton& RefSkeleton = AnimSequence->GetSkeleton()->GetReferenceSkeleton();
+
+		TArray<FSkeletonPoseBoneIndex> SkeletonPoseBoneIndices;
+		SkeletonPoseBoneIndices.Reserve(Request.Bones.Num());
+		for (const FDatasetExportBone& Bone : Request.Bones)
+		{
+			SkeletonPoseBoneIndices.Add(FSkeletonPoseBoneIndex(RefSkeleton.FindBoneIndex(Bone.BoneName)));
+		}
+
+		const int SequenceNumFrames = AnimSequence->GetNumberOfSampledKeys();
+		const double SequenceFrameRate = AnimSequence->GetPlayLength() / SequenceNumFrames;
+
+		AnimationData.SetNum(SequenceNumFrames);
+
+		for (int i = 0; i < SequenceNumFrames; i++) {
+
+			const double CurrentTime = i * SequenceFrameRate;
+
+			TArray<FTransform>& BoneTransforms = AnimationData[i];
+			BoneTransforms.SetNum(SkeletonPoseBoneIndices.Num());
+
+			for (int j = 0; j < SkeletonPoseBoneIndices.Num(); j++) {
+				AnimSequence->GetBoneTransform(BoneTransforms[j], SkeletonPoseBoneIndices[j], CurrentTime, false);
+			}
+		}
+	}
+
+	return AnimationData;
+}
+
+TArray<TArray<FTransform>> FDatasetExporter::RetrieveComponentSpaceTransforms(const TArray<TArray<FTransform>>& BoneTransforms) const
+{
+	TArray<TArray<FTransform>> ComponentSpaceTransforms;
+	ComponentSpaceTransforms.SetNum(BoneTransforms.Num());
+
+	for (int i = 0; i < BoneTransforms.Num(); i++) {
+		TArray<FTransform>& ComponentSpaceFrame = ComponentSpaceTransforms[i];
+		ComponentSpaceFrame.Reserve(BoneTransforms[i].Num());
+
+		for (int j = 0; j < BoneTransforms[i].Num(); j++) {
+			FTransform ComponentSpaceTransform = BoneTransforms[i][j];
+			if (Request.Bones[j].ParentIndex != -1) {
+				FTransform ParentTransform = ComponentSpaceFrame[Request.Bones[j].ParentIndex];
+				ComponentSpaceTransform = ParentTransform.Inverse() * ComponentSpaceTransform;
+			}
+			ComponentSpaceFrame.Add(ComponentSpaceTransform);
+		}
+	}
+	return ComponentSpaceTransforms;
+}
+
+// Writes all bone information into a one-dimensional float array to be saved in a binary file
+namespace
+{
+	// Packs the position and rotation of the given bones into a frames x (bones * 7) matrix
+	// Rotations are kept in the same hemisphere as the previous frame so the quaternion components are continuous
+	void PackBoneTransforms(const TArray<TArray<FTransform>>& BoneTransforms, const TArray<int32>& BoneIndices, TArray<float>& OutMatrix)
+	{
+		const int32 NumChannels = BoneIndices.Num() * 7;
+		OutMatrix.SetNumUninitialized(BoneTransforms.Num() * NumChannels);
+
+		for (int i = 0; i < BoneTransforms.Num(); i++) {
+			for (int j = 0; j < BoneIndices.Num(); j++) {
+				const FTransform& Transform = BoneTransforms[i][BoneIndices[j]];
+				float* Channels = OutMatrix.GetData() + i * NumChannels + j * 7;
+
+				FQuat Rotation = Transform.GetRotation();
+				if (i > 0) {
+					const float* PrevChannels = Channels - NumChannels;
+					const FQuat PrevRotation(PrevChannels[3], PrevChannels[4], PrevChannels[5], PrevChannels[6]);
+					Rotation = (Rotation | PrevRotation) < 0 ? Rotation * -1.0f : Rotation;
+				}
+
+				Channels[0] = Transform.GetLocation().X;
+				Channels[1] = Transform.GetLocation().Y;
+				Channels[2] = Transform.GetLocation().Z;
+				Channels[3] = Rotation.X;
+				Channels[4] = Rotation.Y;
+				Channels[5] = Rotation.Z;
+				Channels[6] = Rotation.W;
+			}
+		}
+	}
+}
+
+void FDatasetExporter::DenoiseBoneTransforms(TArray<TArray<FTransform>>& BoneTransforms) const
+{
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+
+	if (BoneTransforms.Num() == 0) {
+		return;
+	}
+
+	TArray<int32> BoneIndices;
+	for (int j = 0; j < BoneTransforms[0].Num(); j++) {
+		BoneIndices.Add(j);
+	}
+
+	TArray<float> Input;
+	PackBoneTransforms(BoneTransforms, BoneIndices, Input);
+
+	TArray<float> Output;
+	Output.SetNumUninitialized(Input.Num());
+
+	const int32 NumChannels = BoneIndices.Num() * 7;
+	USavGolFilter::FilterMatrix(Input.GetData(), Output.GetData(), BoneTransforms.Num(), NumChannels, FeatureSet->SavGolWindowLength, FeatureSet->SavGolPolyOrder);
+
+	for (int i = 0; i < BoneTransforms.Num(); i++) {
+		for (int j = 0; j < BoneIndices.Num(); j++) {
+			const float* Channels = Output.GetData() + i * NumChannels + j * 7;
+			FQuat Rotation(Channels[3], Channels[4], Channels[5], Channels[6]);
+			Rotation.Normalize();
+			BoneTransforms[i][j].SetLocation(FVector(Channels[0], Channels[1], Channels[2]));
+			BoneTransforms[i][j].SetRotation(Rotation);
+		}
+	}
+}
+
+void FDatasetExporter::ComputeSavGolVelocities(const TArray<TArray<FTransform>>& BoneTransforms, const float FrameRate, TArray<FVector>& OutVelocities, TArray<FVector>& OutAngularVelocities) const
+{
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+
+	TArray<int32> BoneIndices;
+	for (const FDatasetExportBone& Bone : SelectedBones) {
+		BoneIndices.Add(Bone.BoneIndex);
+	}
+
+	TArray<float> Input;
+	PackBoneTransforms(BoneTransforms, BoneIndices, Input);
+
+	TArray<float> Derivatives;
+	Derivatives.SetNumUninitialized(Input.Num());
+
+	const int32 NumChannels = BoneIndices.Num() * 7;
+	USavGolFilter::FilterMatrix(Input.GetData(), Derivatives.GetData(), BoneTransforms.Num(), NumChannels, FeatureSet->SavGolWindowLength, FeatureSet->SavGolPolyOrder, 1, FrameRate);
+
+	OutVelocities.SetNumUninitialized(BoneTransforms.Num() * BoneIndices.Num());
+	OutAngularVelocities.SetNumUninitialized(BoneTransforms.Num() * BoneIndices.Num());
+
+	for (int i = 0; i < BoneTransforms.Num(); i++) {
+		for (int j = 0; j < BoneIndices.Num(); j++) {
+			const float* Channels = Input.GetData() + i * NumChannels + j * 7;
+			const float* Derivative = Derivatives.GetData() + i * NumChannels + j * 7;
+
+			// Angular velocity is 2 * dq/dt * q^-1
+			FQuat Rotation(Channels[3], Channels[4], Channels[5], Channels[6]);
+			Rotation.Normalize();
+			const FQuat AngularVelocity = FQuat(Derivative[3], Derivative[4], Derivative[5], Derivative[6]) * Rotation.Inverse();
+
+			OutVelocities[i * BoneIndices.Num() + j] = FVector(Derivative[0], Derivative[1], Derivative[2]);
+			OutAngularVelocities[i * BoneIndices.Num() + j] = 2.0f * FVector(AngularVelocity.X, AngularVelocity.Y, AngularVelocity.Z);
+		}
+	}
+}
+
+TArray<float> FDatasetExporter::SerializeBoneTransforms(const TArray<TArray<FTransform>>& BoneTransforms, const float FrameRate) const
+{
+	UFeatureSet* FeatureSet = Request.FeatureSet;
+
+	TArray<float> Data;
+	Data.Reserve(BoneTransforms.Num() * FeatureSet->GetDatasetVectorSize());
+
+	const bool bHasVelocities = static_cast<uint8>(FeatureSet->PropertiesToExtract) & (static_cast<uint8>(EFeatureBoneFlags::Velocity) | static_cast<uint8>(EFeatureBoneFlags::AngularVelocity));
+	const bool bUseSavGolVelocities = FeatureSet->bSavGolVelocities && bHasVelocities;
+
+	TArray<FVector> SavGolVelocities;
+	TArray<FVector> SavGolAngularVelocities;
+	if (bUseSavGolVelocities) {
+		ComputeSavGolVelocities(BoneTransforms, FrameRate, SavGolVelocities, SavGolAngularVelocities);
+	}
+
+	for (int i = 0; i < BoneTransforms.Num(); i++) {
+		for (int b = 0; b < SelectedBones.Num(); b++) {
+			const FDatasetExportBone& Bone = SelectedBones[b];
+
+			const int32 BoneIndex = Bone.BoneIndex;
+
+			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Position))
+			{
+				FVector position = BoneTransforms[i][BoneIndex].GetLocation();
+				Data.Add(position.X);
+				Data.Add(position.Y);
+				Data.Add(position.Z);
+			}
+
+			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Rotation))
+			{
+				FQuat rotation = BoneTransforms[i][BoneIndex].GetRotation();
+				switch (FeatureSet->RotationFormat)
+				{
+					case ERotationFormat::Quaternion:
+					{
+						Data.Add(rotation.X);
+						Data.Add(rotation.Y);
+						Data.Add(rotation.Z);
+						Data.Add(rotation.W);
+						break;
+					}
+					case ERotationFormat::XFormXY:
+					{
+						FVector x, y;
+						UFeatureComputation::GetXformXYFromQuat(rotation, x, y);
+						Data.Add(x.X);
+						Data.Add(x.Y);
+						Data.Add(x.Z);
+						Data.Add(y.X);
+						Data.Add(y.Y);
+						Data.Add(y.Z);
+						break;
+					}
+				}
+			}
+
+			const int32 PrevFrame = FMath::Max(i - 1, 0);
+			const int32 NextFrame = FMath::Min(i + 1, BoneTransforms.Num() - 1);
+
+			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::Velocity))
+			{
+				FVector velocity = bUseSavGolVelocities ? SavGolVelocities[i * SelectedBones.Num() + b] :
+					UFeatureComputation::GetBoneVelocity(BoneTransforms[PrevFrame][BoneIndex], BoneTransforms[i][BoneIndex], BoneTransforms[NextFrame][BoneIndex], FrameRate);
+				Data.Add(velocity.X);
+				Data.Add(velocity.Y);
+				Data.Add(velocity.Z);
+			}
+
+			if (static_cast<uint8>(FeatureSet->PropertiesToExtract) & static_cast<uint8>(EFeatureBoneFlags::AngularVelocity))
+			{
+				FVector angularVelocity = bUseSavGolVelocities ? SavGolAngularVelocities[i * SelectedBones.Num() + b] :
+					UFeatureComputation::GetBoneAngularVelocity(BoneTransforms[PrevFrame][BoneIndex], BoneTransforms[i][BoneIndex], BoneTransforms[NextFrame][BoneIndex], FrameRate);
+				Data.Add(angularVelocity.X);
+				Data.Add(angularVelocity.Y);
+				Data.Add(angularVelocity.Z);
+			}
+		}
+	}
+	return Data;
+}
+
+TArray<int32> FDatasetExporter::GetBoneParentIndices() const
+{
+	TArray<int32> ParentIndices;
+	for (const FDatasetExportBone& Bone : Request.Bones) {
+		ParentIndices.Add(Bone.ParentIndex);
+	}
+	return ParentIndices;
+}
+
+FString FDatasetExporter::GetFilePath(const FString& FileName) const
+{
+	return Request.ExportFolder + FileName;
+}
+
+TArray<FString> FDatasetExporter::FindPreviousExportFiles() const
+{
+	IFileManager& FileManager = IFileManager::Get();
+	TArray<FString> FilePaths;
+
+	for (const TCHAR* FileName : { TEXT("parent_indices.bin"), TEXT("sequences.bin"), TEXT("windows.bin") })
+	{
+		if (FileManager.FileExists(*UBinaryBuilder::GetAbsolutePath(GetFilePath(FileName))))
+		{
+			FilePaths.Add(GetFilePath(FileName));
+		}
+	}
+
+	for (const TCHAR* FileName : { TEXT("dataset.bin"), TEXT("features.bin") })
+	{
+		// Monolithic file, manifest and every shard, whichever layout the previous export used
+		TArray<FString> FileNames = { FileName, FString(FileName) + TEXT(".manifest.json") };
+
+		TArray<FString> ShardNames;
+		FileManager.FindFiles(ShardNames, *UBinaryBuilder::GetAbsolutePath(GetFilePath(FString(FileName) + TEXT(".*.bin"))), true, false);
+		FileNames.Append(ShardNames);
+
+		for (const FString& Name : FileNames)
+		{
+			if (FileManager.FileExists(*UBinaryBuilder::GetAbsolutePath(GetFilePath(Name))))
+			{
+				FilePaths.Add(GetFilePath(Name));
+			}
+		}
+	}
+
+	return FilePaths;
+}
+
+#undef LOCTEXT_NAMESPACE
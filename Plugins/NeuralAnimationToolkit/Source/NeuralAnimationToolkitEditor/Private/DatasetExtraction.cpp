@@ -0,0 +1,265 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DatasetExtraction.h"
+#include "AssetRegistry/AssetData.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "AssetRegistry/IAssetRegistry.h"
+#include "Animation/AnimSequenceDecompressionContext.h"
+#include "DatasetExporter.h"
+#include "Framework/Notifications/NotificationManager.h"
+#include "Widgets/Notifications/SNotificationList.h"
+
+#define LOCTEXT_NAMESPACE "DatasetExtraction"
+
+
+void UDatasetExtraction::NativeConstruct()
+{
+        Super::NativeConstruct();
+
+        if (ExportButton)
+        {
+                ExportButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnExportButtonClicked);
+                ExportFolderTextBox->OnTextChanged.AddDynamic(this, &UDatasetExtraction::OnExportFolderTextChanged);
+                LoadFeatureSetButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnLoadFeatureSetButtonClicked);
+                SelectAllBonesButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnSelectAllBonesButtonClicked);
+                SelectAllAnimationsButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnSelectAllAnimationsButtonClicked);
+		DeselectAllBonesButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnDeselectAllBonesButtonClicked);
+		DeselectAllAnimationsButton->OnClicked.AddDynamic(this, &UDatasetExtraction::OnDeselectAllAnimationsButtonClicked);
+        }
+
+        if (FeatureSetPropertyView)
+        {
+                FeatureSetPropertyView->SetPropertyName(GET_MEMBER_NAME_CHECKED(UDatasetExtraction, FeatureSetSchema));
+                FeatureSetPropertyView->SetObject(this);
+        }
+
+        if (DetailsView) {
+                DetailsView->SetObject(FeatureSetSchema);
+                DetailsView->CategoriesToShow.Add(FName("Features"));
+                DetailsView->CategoriesToShow.Add(FName("Dataset"));
+                DetailsView->CategoriesToShow.Add(FName("Schema"));
+                DetailsView->CategoriesToShow.Add(FName("Export"));
+        }
+
+}
+
+// The export function used to compute the feature and dataset arrays and save them in the folder specified by the user
+// The binary can the then read on python side through the BinaryReader.py script located in ExternalTools folder
+// The format of the binary is specified in the BinaryBuilder.h file
+// The extraction itself is done by FDatasetExporter, the editor is blocked behind its progress dialog which reports progress per sequence and can cancel the export
+void UDatasetExtraction::OnExportButtonClicked()
+{
+        if (FeatureSetSchema && AnimSequences.Num() > 0 && BoneInfo.Num() > 0)
+        {
+                FDatasetExportRequest Request;
+                Request.FeatureSet = FeatureSetSchema;
+                Request.ExportFolder = ExportFolderTextBox->GetText().ToString();
+                Request.Options = FeatureSetSchema->ExportOptions;
+
+                for (UBoneInfoEntry* Bone : BoneInfo)
+                {
+                        FDatasetExportBone& ExportBone = Request.Bones.AddDefaulted_GetRef();
+                        ExportBone.BoneName = Bone->GetBoneName();
+                        ExportBone.BoneIndex = Bone->GetBoneIndex();
+                        ExportBone.ParentIndex = Bone->GetParentIndex();
+                        ExportBone.bIsSelected = Bone->bIsSelected;
+                }
+
+                for (UAnimSequenceEntry* AnimSequence : AnimSequences)
+                {
+                        if (AnimSequence->bIsSelected) {
+                                Request.Sequences.Add(AnimSequence->GetAnimSequence().ToSoftObjectPath());
+                        }
+                }
+
+                FDatasetExporter Exporter(Request);
+                FDatasetExportTimings Timings;
+                EDatasetExportResult Result = Exporter.Run(Timings);
+
+                FText Message;
+                switch (Result)
+                {
+                        case EDatasetExportResult::Success:
+                                Message = FText::Format(LOCTEXT("ExportSucceeded", "Dataset exported\n{0}"), FText::FromString(Timings.ToString()));
+                                break;
+                        case EDatasetExportResult::Cancelled:
+                                Message = LOCTEXT("ExportCancelled", "Dataset export cancelled");
+                                break;
+                        default:
+                                Message = LOCTEXT("ExportFailed", "Dataset export failed, see the output log");
+                                break;
+                }
+
+                FNotificationInfo Info(Message);
+                Info.ExpireDuration = 10.0f;
+                FSlateNotificationManager::Get().AddNotification(Info);
+        }
+}
+
+// Loads the feature set and retrieves the bone information and animation sequences that reference the skeleton specified in the FeatureSetSchema
+void UDatasetExtraction::OnLoadFeatureSetButtonClicked()
+{
+        FName PropertyName = FeatureSetPropertyView->GetPropertyName();
+
+        if (PropertyName == GET_MEMBER_NAME_CHECKED(UDatasetExtraction, FeatureSetSchema))
+        {
+                if (FeatureSetSchema)
+                {
+                        Skeleton = FeatureSetSchema->Skeleton;
+
+                        RetirieveBoneInfo();
+
+                        RetirieveAnimSequences();
+
+                        if (SequenceListView)
+                        {
+                                SequenceListView->SetListItems(AnimSequences);
+                        }
+
+                        if (BoneListView)
+                        {
+                                BoneListView->SetListItems(BoneInfo);
+                        }
+                }
+        }
+
+        if (DetailsView) {
+                DetailsView->SetObject(FeatureSetSchema);
+        }
+}
+
+void UDatasetExtraction::OnSelectAllBonesButtonClicked()
+{
+        for (UBoneInfoEntry* Bone : BoneInfo)
+        {
+                Bone->bIsSelected = true;
+        }
+
+        if (BoneListView)
+        {
+                BoneListView->ClearListItems();
+                BoneListView->SetListItems(BoneInfo);
+		TArray<UObject*> Items = BoneListView->GetListItems();
+
+                for (UObject* Item : Items) {
+
+			UListEntry* ListEntry = Cast<UListEntry>(BoneListView->GetEntryWidgetFromItem(Item));
+                        if (ListEntry) {
+                                ListEntry->SetCheckBox(true);
+                        }
+                }
+        }
+}
+
+void UDatasetExtraction::OnSelectAllAnimationsButtonClicked()
+{
+        for (UAnimSequenceEntry* AnimSequence : AnimSequences)
+        {
+                AnimSequence->bIsSelected = true;
+        }
+
+        if (SequenceListView)
+        {
+                SequenceListView->ClearListItems();
+                SequenceListView->SetListItems(AnimSequences);
+                TArray<UObject*> Items = SequenceListView->GetListItems();
+
+                for (UObject* Item : Items) {
+
+                        UListEntry* ListEntry = Cast<UListEntry>(SequenceListView->GetEntryWidgetFromItem(Item));
+                        if (ListEntry) {
+                                ListEntry->SetCheckBox(true);
+                        }
+                }
+        }
+}
+
+void UDatasetExtraction::OnDeselectAllBonesButtonClicked()
+{
+        for (UBoneInfoEntry* Bone : BoneInfo)
+        {
+                Bone->bIsSelected = false;
+        }
+
+        if (BoneListView)
+        {
+                BoneListView->ClearListItems();
+                BoneListView->SetListItems(BoneInfo);
+                TArray<UObject*> Items = BoneListView->GetListItems();
+
+                for (UObject* Item : Items) {
+
+                        UListEntry* ListEntry = Cast<UListEntry>(BoneListView->GetEntryWidgetFromItem(Item));
+                        if (ListEntry) {
+                                ListEntry->SetCheckBox(false);
+                        }
+                }
+        }
+}
+
+void UDatasetExtraction::OnDeselectAllAnimationsButtonClicked()
+{
+        for (UAnimSequenceEntry* AnimSequence : AnimSequences)
+        {
+                AnimSequence->bIsSelected = false;
+        }
+
+        if (SequenceListView)
+        {
+                SequenceListView->ClearListItems();
+                SequenceListView->SetListItems(AnimSequences);
+                TArray<UObject*> Items = SequenceListView->GetListItems();
+
+                for (UObject* Item : Items) {
+
+                        UListEntry* ListEntry = Cast<UListEntry>(SequenceListView->GetEntryWidgetFromItem(Item));
+                        if (ListEntry) {
+                                ListEntry->SetCheckBox(false);
+                        }
+                }
+        }
+}
+
+
+void UDatasetExtraction::OnExportFolderTextChanged(const FText& Text)
+{
+        ExportFolder = Text.ToString();
+}
+
+void UDatasetExtraction::RetirieveBoneInfo() {
+        if (Skeleton) {
+
+                BoneInfo.Empty();
+
+                TArray<FMeshBoneInfo> BoneContainer = Skeleton->GetReferenceSkeleton().GetRefBoneInfo();
+
+                for (int i = 0; i < BoneContainer.Num(); i++) {
+                        UBoneInfoEntry* BoneInfoObj = NewObject<UBoneInfoEntry>();
+                        BoneInfoObj->SetBone(BoneContainer[i].Name, i, BoneContainer[i].ParentIndex);
+                        BoneInfo.Add(BoneInfoObj);
+                }
+        }
+}
+
+// Retrieve all animation sequences that reference the skeleton specified in the FeatureSetSchema
+void UDatasetExtraction::RetirieveAnimSequences() {
+        if (Skeleton) {
+
+                AnimSequences.Empty();
+
+                // Only the asset registry data is used here, the sequences are streamed in during export
+                for (const FAssetData& Asset : FDatasetExporter::FindAnimSequences(Skeleton))
+                {
+                        int32 NumFrames = INDEX_NONE;
+                        float SequenceLength = 0.0f;
+                        FDatasetExporter::GetSequenceInfo(Asset, NumFrames, SequenceLength);
+
+                        UAnimSequenceEntry* AnimSequenceObj = NewObject<UAnimSequenceEntry>();
+                        AnimSequenceObj->SetAnimSequence(Asset, NumFrames, SequenceLength);
+                        AnimSequences.Add(AnimSequenceObj);
+                }
+        }
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -10,7 +10,7 @@
  *
  */
 UCLASS()
-class NEURALANIMATIONTOOLKIT_API UAnimGraphNode_NN : public UAnimGraphNode_Base
+class NEURALANIMATIONTOOLKITEDITOR_API UAnimGraphNode_NN : public UAnimGraphNode_Base
 {
 	GENERATED_BODY()
 
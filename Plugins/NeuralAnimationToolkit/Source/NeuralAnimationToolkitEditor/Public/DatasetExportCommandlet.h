@@ -0,0 +1,35 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DatasetExportCommandlet.generated.h"
+
+// Headless version of the DatasetExtraction widget, runs the same extraction pipeline without a human in the editor
+//
+// Usage:
+// UnrealEditor-Cmd <Project> -run=DatasetExport -FeatureSet=/Game/Path/FeatureSet -Output=Dataset/ [options] -unattended -nullrhi
+//
+// -FeatureSet=     Path of the UFeatureSet asset to export with
+// -Output=         Output folder, relative to the project directory unless absolute
+// -Bones=          Comma separated list of bones to export or "all" (default)
+// -Path=           Only export sequences located under this content path
+// -Regex=          Only export sequences whose object path matches this regular expression
+// -Collection=     Only export sequences contained in this asset collection
+// -Workers=        Number of sequences processed in parallel, 0 (default) uses all task graph workers
+// -Shards=         Write dataset.bin and features.bin as shards of this many frames, overrides the feature set export options
+// -Encoding=       Float32, Float16, Quantized16 or Quantized8, only used for sharded output
+// -Compression=    None, LZ4, Zlib or Oodle, only used for sharded output
+// -History=        Export windows.bin with this many history frames per window, overrides the feature set export options
+// -Future=         Number of future frames per window in windows.bin
+UCLASS()
+class NEURALANIMATIONTOOLKITEDITOR_API UDatasetExportCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDatasetExportCommandlet();
+
+	// UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// End UCommandlet interface
+};
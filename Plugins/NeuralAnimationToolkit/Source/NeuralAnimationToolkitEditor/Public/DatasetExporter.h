@@ -0,0 +1,118 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetRegistry/AssetData.h"
+#include "Engine/StreamableManager.h"
+#include "Features.h"
+
+class FBinaryFileWriter;
+class UAnimSequence;
+class USkeleton;
+
+// Bone description used by the exporter, mirrors the UBoneInfoEntry shown in the DatasetExtraction widget
+struct FDatasetExportBone
+{
+	FName BoneName;
+	int32 BoneIndex = INDEX_NONE;
+	int32 ParentIndex = INDEX_NONE;
+	bool bIsSelected = false;
+};
+
+// Time spent in each stage of the export in seconds
+// Stage timings are summed over all sequences (and therefore over all workers), Total is the wall time of the whole export
+struct NEURALANIMATIONTOOLKITEDITOR_API FDatasetExportTimings
+{
+	double Decode = 0.0;
+	double Filter = 0.0;
+	double ForwardKinematics = 0.0;
+	double Serialization = 0.0;
+	double Features = 0.0;
+	double FileWrite = 0.0;
+	double Total = 0.0;
+
+	FDatasetExportTimings& operator+=(const FDatasetExportTimings& Other);
+
+	FString ToString() const;
+};
+
+// Everything the exporter needs to know, filled in either by the DatasetExtraction widget or by a commandlet
+struct FDatasetExportRequest
+{
+	UFeatureSet* FeatureSet = nullptr;
+
+	// All bones of the skeleton in reference skeleton order, the selected ones are written to the dataset
+	TArray<FDatasetExportBone> Bones;
+
+	// Sequences are streamed in batch by batch during the export and released again once processed
+	TArray<FSoftObjectPath> Sequences;
+
+	FString ExportFolder;
+
+	// Number of sequences processed in parallel, 0 uses all task graph workers
+	int32 NumWorkers = 0;
+
+	// Layout of dataset.bin and features.bin, defaults to the options stored on the feature set
+	FDatasetExportOptions Options;
+};
+
+enum class EDatasetExportResult : uint8
+{
+	Success,
+	Cancelled,
+	Failed,
+};
+
+// Runs the dataset extraction pipeline
+// Sequences are streamed in asynchronously one batch ahead, then decoded, optionally denoised, converted to component space, serialized and passed through the feature set in parallel batches
+// The results of each batch are appended to the files and released, so only one batch is held in memory
+// Progress is reported through a modal FScopedSlowTask and can be cancelled between batches
+// Run blocks the game thread for the whole export, only the sequences of a batch are processed on the task graph workers
+// All files are first written next to their final location and only moved in place once every file has been written
+// All files of a previous export are moved aside before, and restored if moving the new files in place fails, so the folder only ever holds a single export
+class NEURALANIMATIONTOOLKITEDITOR_API FDatasetExporter
+{
+public:
+	FDatasetExporter(const FDatasetExportRequest& InRequest);
+
+	// Must be called from the game thread, which it blocks until the export has finished or been cancelled
+	EDatasetExportResult Run(FDatasetExportTimings& OutTimings);
+
+	// Finds all animation sequences in the asset registry that reference the given skeleton
+	static TArray<FAssetData> FindAnimSequences(const USkeleton* Skeleton);
+
+	// Reads the frame count and length of a sequence from its asset registry tags without loading it
+	static bool GetSequenceInfo(const FAssetData& AssetData, int32& OutNumFrames, float& OutSequenceLength);
+
+private:
+	struct FSequenceResult
+	{
+		TArray<float> Data;
+		TArray<float> FeatureData;
+		int32 NumFrames = 0;
+		FDatasetExportTimings Timings;
+	};
+
+	void ProcessSequence(UAnimSequence* AnimSequence, FSequenceResult& OutResult) const;
+
+	// dataset.bin and features.bin are appended to while the sequences are processed, the small files are written once all sequences are known
+	TUniquePtr<FBinaryFileWriter> CreateFileWriter(const FString& FileName, const TArray<int32>& RowDimensions) const;
+	bool WriteFiles(const TArray<int32>& SequenceFrames, FBinaryFileWriter& DatasetWriter, FBinaryFileWriter& FeatureWriter, FDatasetExportTimings& OutTimings) const;
+
+	TArray<TArray<FTransform>> GetBoneTransforms(UAnimSequence* AnimSequence) const;
+	TArray<TArray<FTransform>> RetrieveComponentSpaceTransforms(const TArray<TArray<FTransform>>& BoneTransforms) const;
+	void DenoiseBoneTransforms(TArray<TArray<FTransform>>& BoneTransforms) const;
+	void ComputeSavGolVelocities(const TArray<TArray<FTransform>>& BoneTransforms, const float FrameRate, TArray<FVector>& OutVelocities, TArray<FVector>& OutAngularVelocities) const;
+	TArray<float> SerializeBoneTransforms(const TArray<TArray<FTransform>>& BoneTransforms, const float FrameRate) const;
+	TArray<int32> GetBoneParentIndices() const;
+
+	FString GetFilePath(const FString& FileName) const;
+
+	// Every file in the export folder a previous export may have written, with dataset.bin and features.bin in either layout
+	TArray<FString> FindPreviousExportFiles() const;
+
+	TSharedPtr<FStreamableHandle> RequestSequenceBatch(int32 BatchStart, int32 BatchSize);
+
+	FDatasetExportRequest Request;
+	TArray<FDatasetExportBone> SelectedBones;
+	FStreamableManager StreamableManager;
+};
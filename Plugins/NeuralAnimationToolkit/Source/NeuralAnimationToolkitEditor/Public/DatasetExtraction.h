@@ -41,23 +41,30 @@ public:
         UAnimSequenceEntry() {}
         UAnimSequenceEntry(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer) {}
 
-        UAnimSequenceEntry(UAnimSequence* InAnimSequence)
+        // The entry is built from the asset registry only, the sequence itself is not loaded until it is exported
+        void SetAnimSequence(const FAssetData& InAssetData, int32 InNumFrames, float InSequenceLength)
         {
-                AnimSequence = InAnimSequence;
-                EntryText = FText::FromName(AnimSequence->GetFName());
+                AnimSequence = TSoftObjectPtr<UAnimSequence>(InAssetData.GetSoftObjectPath());
+                NumFrames = InNumFrames;
+                SequenceLength = InSequenceLength;
+                EntryText = NumFrames != INDEX_NONE
+                        ? FText::FromString(FString::Printf(TEXT("%s (%d frames, %.2fs)"), *InAssetData.AssetName.ToString(), NumFrames, SequenceLength))
+                        : FText::FromName(InAssetData.AssetName);
         }
 
-        void SetAnimSequence(UAnimSequence* InAnimSequence)
-        {
-                AnimSequence = InAnimSequence;
-                EntryText = FText::FromName(AnimSequence->GetFName());
-        }
-
-        UAnimSequence* GetAnimSequence() const { return AnimSequence; }
+        const TSoftObjectPtr<UAnimSequence>& GetAnimSequence() const { return AnimSequence; }
+        int32 GetNumFrames() const { return NumFrames; }
+        float GetSequenceLength() const { return SequenceLength; }
 
 protected:
         UPROPERTY(EditAnywhere, BlueprintReadWrite)
-        UAnimSequence* AnimSequence;
+        TSoftObjectPtr<UAnimSequence> AnimSequence;
+
+        UPROPERTY(EditAnywhere, BlueprintReadWrite)
+        int32 NumFrames = INDEX_NONE;
+
+        UPROPERTY(EditAnywhere, BlueprintReadWrite)
+        float SequenceLength = 0.0f;
 
 };
 
@@ -251,9 +258,4 @@ private:
         void RetirieveBoneInfo();
 
         void RetirieveAnimSequences();
-
-        TArray<TArray<FTransform>> GetBoneTransforms(UAnimSequence* AnimSequence, TArray<UBoneInfoEntry*> RequiredBones);
-        TArray<TArray<FTransform>> RetrieveComponentSpaceTransforms(TArray<TArray<FTransform>> BoneTransforms, TArray<UBoneInfoEntry*> RequiredBones);
-	TArray<float> SerializeBoneTransforms(const TArray<TArray<FTransform>>& BoneTransforms, const TArray<UBoneInfoEntry*> SelectedBones, const float frameRate);
-        TArray<int32> GetBoneParentIndices(const TArray<UBoneInfoEntry*> RequiredBones);
 };
@@ -12,7 +12,7 @@
 // Widget to display the properties of each feature into a list
 // Provides a way to easily display and modify the features in the feature set
 UCLASS(Abstract)
-class NEURALANIMATIONTOOLKIT_API UFeatureDetailsEntry : public UUserWidget, public IUserObjectListEntry
+class NEURALANIMATIONTOOLKITEDITOR_API UFeatureDetailsEntry : public UUserWidget, public IUserObjectListEntry
 {
 	GENERATED_BODY()
 
@@ -35,7 +35,7 @@ private:
 // NOTE: Each time you introduce a new feature class, provide a new button to create a new feature of that class. Simply copy paste the code from the existing buttons and change the class name
 
 UCLASS(Abstract)
-class NEURALANIMATIONTOOLKIT_API UFeatureSetBuilder : public UEditorUtilityWidget
+class NEURALANIMATIONTOOLKITEDITOR_API UFeatureSetBuilder : public UEditorUtilityWidget
 {
 	GENERATED_BODY()
 
@@ -8,7 +8,7 @@
 class FToolBarBuilder;
 class FMenuBuilder;
 
-class FNeuralAnimationToolkitModule : public IModuleInterface
+class FNeuralAnimationToolkitEditorModule : public IModuleInterface
 {
 public:
 